@@ -1,26 +1,129 @@
 #include "arena.h"
+#include <stdint.h>
 #include <stdlib.h>
 
+#define ARENA_MIN_CHUNK 1024
+#define ARENA_MAX_CHUNK (64 * 1024)
+#define ARENA_SPARE_MAX 32
+
 Arena global_arena;
+size_t arena_bytes;
 
-void arena_init(Arena *arena) { arena->head = NULL; }
+// Chunks given back by arena_release/arena_reset are kept here and handed
+// to the next arena that runs out of room, so a statement loop or a
+// redefined lambda does not go back to malloc.
+static ArenaChunk *spare;
+static size_t spare_count;
 
-void *arena_alloc(Arena *arena, size_t size) {
-  ArenaBlock *block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + size);
-  if (!block)
+void arena_init(Arena *arena) {
+  arena->head = NULL;
+  arena->next_size = ARENA_MIN_CHUNK;
+}
+
+static void chunk_recycle(ArenaChunk *chunk) {
+  // oversized chunks made for one big request are not worth keeping
+  if (spare_count >= ARENA_SPARE_MAX || chunk->size > ARENA_MAX_CHUNK) {
+    arena_bytes -= chunk->size;
+    free(chunk);
+    return;
+  }
+  chunk->prev = spare;
+  spare = chunk;
+  spare_count++;
+}
+
+static ArenaChunk *chunk_acquire(size_t need) {
+  for (ArenaChunk **p = &spare; *p; p = &(*p)->prev) {
+    if ((*p)->size >= need) {
+      ArenaChunk *chunk = *p;
+      *p = chunk->prev;
+      spare_count--;
+      return chunk;
+    }
+  }
+  ArenaChunk *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + need);
+  if (chunk) {
+    chunk->size = need;
+    arena_bytes += need;
+  }
+  return chunk;
+}
+
+static void *chunk_bump(ArenaChunk *chunk, size_t size, size_t align) {
+  uintptr_t base = (uintptr_t)chunk->data;
+  uintptr_t p = (base + chunk->used + align - 1) & ~(uintptr_t)(align - 1);
+  if (p + size > base + chunk->size)
     return NULL;
-  block->next = arena->head;
-  block->size = size;
-  arena->head = block;
-  return block->data;
+  chunk->used = p + size - base;
+  return (void *)p;
+}
+
+void *arena_alloc_aligned(Arena *arena, size_t size, size_t align) {
+  if (arena->head) {
+    void *p = chunk_bump(arena->head, size, align);
+    if (p)
+      return p;
+  }
+  size_t need = size + align;
+  if (need < arena->next_size)
+    need = arena->next_size;
+  if (arena->next_size < ARENA_MAX_CHUNK)
+    arena->next_size *= 2;
+  ArenaChunk *chunk = chunk_acquire(need);
+  if (!chunk)
+    return NULL;
+  chunk->used = 0;
+  chunk->prev = arena->head;
+  arena->head = chunk;
+  return chunk_bump(chunk, size, align);
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  return arena_alloc_aligned(arena, size, _Alignof(max_align_t));
+}
+
+ArenaMark arena_mark(Arena *arena) {
+  ArenaMark mark = {arena->head, arena->head ? arena->head->used : 0};
+  return mark;
+}
+
+// Drop everything allocated since mark was taken.
+void arena_release(Arena *arena, ArenaMark mark) {
+  while (arena->head && arena->head != mark.chunk) {
+    ArenaChunk *prev = arena->head->prev;
+    chunk_recycle(arena->head);
+    arena->head = prev;
+  }
+  if (arena->head)
+    arena->head->used = mark.used;
+}
+
+void arena_reset(Arena *arena) {
+  ArenaMark start = {NULL, 0};
+  arena_release(arena, start);
 }
 
 void arena_dispose(Arena *arena) {
-  ArenaBlock *block = arena->head;
-  while (block) {
-    ArenaBlock *next = block->next;
-    free(block);
-    block = next;
+  ArenaChunk *chunk = arena->head;
+  while (chunk) {
+    ArenaChunk *prev = chunk->prev;
+    arena_bytes -= chunk->size;
+    free(chunk);
+    chunk = prev;
   }
   arena->head = NULL;
+  while (spare) {
+    ArenaChunk *prev = spare->prev;
+    arena_bytes -= spare->size;
+    free(spare);
+    spare = prev;
+  }
+  spare_count = 0;
+}
+
+size_t arena_size(const Arena *arena) {
+  size_t size = 0;
+  for (ArenaChunk *chunk = arena->head; chunk; chunk = chunk->prev)
+    size += chunk->size;
+  return size;
 }
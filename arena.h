@@ -3,20 +3,33 @@
 
 #include <stddef.h>
 
-typedef struct ArenaBlock {
-  struct ArenaBlock *next;
+typedef struct ArenaChunk {
+  struct ArenaChunk *prev;
   size_t size;
+  size_t used;
   unsigned char data[];
-} ArenaBlock;
+} ArenaChunk;
 
 typedef struct Arena {
-  ArenaBlock *head;
+  ArenaChunk *head;
+  size_t next_size;
 } Arena;
 
+typedef struct ArenaMark {
+  ArenaChunk *chunk;
+  size_t used;
+} ArenaMark;
+
 void arena_init(Arena *arena);
 void *arena_alloc(Arena *arena, size_t size);
+void *arena_alloc_aligned(Arena *arena, size_t size, size_t align);
+ArenaMark arena_mark(Arena *arena);
+void arena_release(Arena *arena, ArenaMark mark);
+void arena_reset(Arena *arena);
 void arena_dispose(Arena *arena);
+size_t arena_size(const Arena *arena);
 
+extern size_t arena_bytes; // held in chunks by all arenas and the spare pool
 extern Arena global_arena;
 
 #endif
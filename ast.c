@@ -28,22 +28,16 @@ static void print_kobj(KObj *obj) {
     printf("-0w");
     break;
   case VECTOR: {
-    bool is_string = true;
-    for (size_t i = 0; i < obj->as.vector->length; i++) {
-      if (obj->as.vector->items[i].type != CHAR) {
-        is_string = false;
-        break;
-      }
-    }
-    if (is_string) {
-      for (size_t i = 0; i < obj->as.vector->length; i++) {
-        printf("%c", obj->as.vector->items[i].as.char_value);
-      }
+    KVec *v = obj->as.vector;
+    if (v->elem == CHAR) {
+      printf("%.*s", (int)v->length, v->chars);
     } else {
       printf("(");
-      for (size_t i = 0; i < obj->as.vector->length; i++) {
-        print_kobj(&obj->as.vector->items[i]);
-        if (i + 1 < obj->as.vector->length)
+      for (size_t i = 0; i < v->length; i++) {
+        KObj *item = vector_get(obj, i);
+        print_kobj(item);
+        release_object(item);
+        if (i + 1 < v->length)
           printf(" ");
       }
       printf(")");
@@ -56,8 +50,10 @@ static void print_kobj(KObj *obj) {
   }
 }
 
+Arena *ast_arena = &global_arena;
+
 ASTNode *create_literal_node(KObj *value) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_LITERAL;
   retain_object(value);
   node->as.literal.value = value;
@@ -65,7 +61,7 @@ ASTNode *create_literal_node(KObj *value) {
 }
 
 ASTNode *create_unary_node(Token op, ASTNode *child) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_UNARY;
   node->as.unary.op = op;
   node->as.unary.child = child;
@@ -73,7 +69,7 @@ ASTNode *create_unary_node(Token op, ASTNode *child) {
 }
 
 ASTNode *create_binary_node(Token op, ASTNode *left, ASTNode *right) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_BINARY;
   node->as.binary.op = op;
   node->as.binary.left = left;
@@ -82,7 +78,7 @@ ASTNode *create_binary_node(Token op, ASTNode *left, ASTNode *right) {
 }
 
 ASTNode *create_call_node(ASTNode *callee, ASTNode **args, size_t arg_count) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_CALL;
   node->as.call.callee = callee;
   node->as.call.args = args;
@@ -91,7 +87,7 @@ ASTNode *create_call_node(ASTNode *callee, ASTNode **args, size_t arg_count) {
 }
 
 ASTNode *create_seq_node(ASTNode **items, size_t count) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_SEQ;
   node->as.seq.items = items;
   node->as.seq.count = count;
@@ -99,7 +95,7 @@ ASTNode *create_seq_node(ASTNode **items, size_t count) {
 }
 
 ASTNode *create_list_node(ASTNode **items, size_t count) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_LIST;
   node->as.seq.items = items;
   node->as.seq.count = count;
@@ -108,7 +104,7 @@ ASTNode *create_list_node(ASTNode **items, size_t count) {
 
 ASTNode *create_conditional_node(ASTNode *condition, ASTNode *then_branch,
                                  ASTNode *else_branch) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_CONDITIONAL;
   node->as.conditional.condition = condition;
   node->as.conditional.then_branch = then_branch;
@@ -117,7 +113,7 @@ ASTNode *create_conditional_node(ASTNode *condition, ASTNode *then_branch,
 }
 
 ASTNode *create_adverb_node(Token op, ASTNode *child) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_ADVERB;
   node->as.adverb.op = op;
   node->as.adverb.child = child;
@@ -125,7 +121,7 @@ ASTNode *create_adverb_node(Token op, ASTNode *child) {
 }
 
 ASTNode *create_var_node(const char *name) {
-  ASTNode *node = (ASTNode *)arena_alloc(&global_arena, sizeof(ASTNode));
+  ASTNode *node = (ASTNode *)arena_alloc(ast_arena, sizeof(ASTNode));
   node->type = AST_VAR;
   node->as.var.name = name;
   return node;
@@ -170,3 +166,49 @@ void free_ast(ASTNode *node) {
     break;
   }
 }
+
+static ASTNode **copy_items(ASTNode **items, size_t count) {
+  ASTNode **copy =
+      (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * (count + 1));
+  for (size_t i = 0; i < count; i++)
+    copy[i] = copy_ast(items[i]);
+  return copy;
+}
+
+ASTNode *copy_ast(ASTNode *node) {
+  if (node == NULL)
+    return NULL;
+  switch (node->type) {
+  case AST_LITERAL:
+    return create_literal_node(node->as.literal.value);
+  case AST_UNARY:
+    return create_unary_node(node->as.unary.op, copy_ast(node->as.unary.child));
+  case AST_BINARY:
+    return create_binary_node(node->as.binary.op,
+                              copy_ast(node->as.binary.left),
+                              copy_ast(node->as.binary.right));
+  case AST_CALL:
+    return create_call_node(
+        copy_ast(node->as.call.callee),
+        copy_items(node->as.call.args, node->as.call.arg_count),
+        node->as.call.arg_count);
+  case AST_SEQ:
+    return create_seq_node(copy_items(node->as.seq.items, node->as.seq.count),
+                           node->as.seq.count);
+  case AST_LIST:
+    return create_list_node(
+        copy_items(node->as.seq.items, node->as.seq.count),
+        node->as.seq.count);
+  case AST_CONDITIONAL:
+    return create_conditional_node(
+        copy_ast(node->as.conditional.condition),
+        copy_ast(node->as.conditional.then_branch),
+        copy_ast(node->as.conditional.else_branch));
+  case AST_ADVERB:
+    return create_adverb_node(node->as.adverb.op,
+                              copy_ast(node->as.adverb.child));
+  case AST_VAR:
+    return create_var_node(node->as.var.name);
+  }
+  return NULL;
+}
@@ -65,5 +65,11 @@ ASTNode *create_conditional_node(ASTNode *condition, ASTNode *then_branch,
 ASTNode *create_adverb_node(Token op, ASTNode *child);
 ASTNode *create_var_node(const char *name);
 void free_ast(ASTNode *node);
+// Deep copy into ast_arena, sharing the literal values.
+ASTNode *copy_ast(ASTNode *node);
+
+// Arena new nodes are allocated from: the statement being parsed, or the
+// body of the lambda being parsed.
+extern Arena *ast_arena;
 
 #endif
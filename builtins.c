@@ -1,6 +1,9 @@
 #include "builtins.h"
+#include "arena.h"
 #include "def.h"
 #include "eval.h"
+#include "ops.h"
+#include "sym.h"
 #include <ctype.h>
 #include <math.h>
 #include <stdbool.h>
@@ -42,6 +45,21 @@ static int64_t as_int(KObj *o) {
   }
 }
 
+// Payload of an INT or FLOAT atom, as stored in a virtual vector.
+static KNum num_of(KObj *o) {
+  KNum n;
+  if (o->type == INT)
+    n.i = o->as.int_value;
+  else
+    n.f = o->as.float_value;
+  return n;
+}
+
+static bool is_single_char(KObj *v) {
+  return v->type == VECTOR && v->as.vector->length == 1 &&
+         v->as.vector->elem == CHAR;
+}
+
 static bool obj_match(KObj *left, KObj *right) {
   if (left->type != right->type)
     return false;
@@ -58,29 +76,41 @@ static bool obj_match(KObj *left, KObj *right) {
   case NINF:
     return true;
   case SYM:
-    return strcmp(left->as.symbol_value, right->as.symbol_value) == 0;
-  case VECTOR:
-    if (left->as.vector->length != right->as.vector->length)
+    return left->as.symbol_value == right->as.symbol_value;
+  case VECTOR: {
+    KVec *lv = left->as.vector;
+    KVec *rv = right->as.vector;
+    if (lv->length != rv->length)
       return false;
-    for (size_t i = 0; i < left->as.vector->length; i++) {
-      KObj *l = &left->as.vector->items[i];
-      KObj *r = &right->as.vector->items[i];
-      if (l->type == CHAR && r->type == VECTOR && r->as.vector->length == 1 &&
-          r->as.vector->items[0].type == CHAR) {
-        if (l->as.char_value != r->as.vector->items[0].as.char_value)
+    if (lv->elem != NIL && lv->elem == rv->elem) {
+      for (size_t i = 0; i < lv->length; i++) {
+        bool same = lv->elem == INT     ? lv->ints[i] == rv->ints[i]
+                    : lv->elem == FLOAT ? lv->floats[i] == rv->floats[i]
+                    : lv->elem == SYM   ? lv->syms[i] == rv->syms[i]
+                                        : lv->chars[i] == rv->chars[i];
+        if (!same)
           return false;
-        continue;
       }
-      if (r->type == CHAR && l->type == VECTOR && l->as.vector->length == 1 &&
-          l->as.vector->items[0].type == CHAR) {
-        if (r->as.char_value != l->as.vector->items[0].as.char_value)
-          return false;
-        continue;
+      return true;
+    }
+    for (size_t i = 0; i < lv->length; i++) {
+      KObj *l = vector_get(left, i);
+      KObj *r = vector_get(right, i);
+      bool same;
+      if (l->type == CHAR && is_single_char(r)) {
+        same = l->as.char_value == r->as.vector->chars[0];
+      } else if (r->type == CHAR && is_single_char(l)) {
+        same = r->as.char_value == l->as.vector->chars[0];
+      } else {
+        same = obj_match(l, r);
       }
-      if (!obj_match(l, r))
+      release_object(l);
+      release_object(r);
+      if (!same)
         return false;
     }
     return true;
+  }
   case DICT:
     return obj_match(left->as.dict->keys, right->as.dict->keys) &&
            obj_match(left->as.dict->values, right->as.dict->values);
@@ -101,6 +131,8 @@ static KObj *apply_dict_binary(KObj *left, KObj *right,
                                KObj *(*op)(KObj *, KObj *));
 static KObj *apply_vector_binary(KObj *left, KObj *right,
                                  KObj *(*op)(KObj *, KObj *));
+static KObj *flat_binary(KObj *left, KObj *right,
+                         KObj *(*op)(KObj *, KObj *), bool reuse);
 
 static KObj *apply_binary(KObj *left, KObj *right,
                           KObj *(*op)(KObj *, KObj *)) {
@@ -140,40 +172,25 @@ static KObj *apply_dict_binary(KObj *left, KObj *right,
 
 static KObj *apply_vector_binary(KObj *left, KObj *right,
                                  KObj *(*op)(KObj *, KObj *)) {
-  if (left->type == VECTOR && right->type == VECTOR) {
-    if (left->as.vector->length != right->as.vector->length) {
-      printf("^length\n");
-      return create_nil();
-    }
-    KObj *vec = create_vec(left->as.vector->length);
-    for (size_t i = 0; i < left->as.vector->length; i++) {
-      KObj *res = apply_binary(&left->as.vector->items[i],
-                               &right->as.vector->items[i], op);
-      if (res->type == NIL) {
-        release_object(vec);
-        return res;
-      }
-      vector_append(vec, res);
-      release_object(res);
-    }
-    return vec;
-  }
-  if (left->type == VECTOR) {
-    KObj *vec = create_vec(left->as.vector->length);
-    for (size_t i = 0; i < left->as.vector->length; i++) {
-      KObj *res = apply_binary(&left->as.vector->items[i], right, op);
-      if (res->type == NIL) {
-        release_object(vec);
-        return res;
-      }
-      vector_append(vec, res);
-      release_object(res);
-    }
-    return vec;
+  if (left->type == VECTOR && right->type == VECTOR &&
+      left->as.vector->length != right->as.vector->length) {
+    printf("^length\n");
+    return create_nil();
   }
-  KObj *vec = create_vec(right->as.vector->length);
-  for (size_t i = 0; i < right->as.vector->length; i++) {
-    KObj *res = apply_binary(left, &right->as.vector->items[i], op);
+  KObj *flat = flat_binary(left, right, op, false);
+  if (flat)
+    return flat;
+  size_t len = left->type == VECTOR ? left->as.vector->length
+                                    : right->as.vector->length;
+  KObj *vec = create_vec(len);
+  for (size_t i = 0; i < len; i++) {
+    KObj *l = left->type == VECTOR ? vector_get(left, i) : left;
+    KObj *r = right->type == VECTOR ? vector_get(right, i) : right;
+    KObj *res = apply_binary(l, r, op);
+    if (l != left)
+      release_object(l);
+    if (r != right)
+      release_object(r);
     if (res->type == NIL) {
       release_object(vec);
       return res;
@@ -288,7 +305,7 @@ static KObj *op_lt(KObj *left, KObj *right) {
     return create_int(as_int(left) < as_int(right));
   }
   if (left->type == SYM && right->type == SYM)
-    return create_int(strcmp(left->as.symbol_value, right->as.symbol_value) <
+    return create_int(sym_cmp(left->as.symbol_value, right->as.symbol_value) <
                       0);
   return create_int(0);
 }
@@ -303,8 +320,7 @@ static KObj *op_eq(KObj *left, KObj *right) {
     return create_int(as_double(left) == as_double(right));
   }
   if (left->type == SYM && right->type == SYM)
-    return create_int(strcmp(left->as.symbol_value, right->as.symbol_value) ==
-                      0);
+    return create_int(left->as.symbol_value == right->as.symbol_value);
   if (left->type == right->type) {
     if (left->type == NIL)
       return create_int(1);
@@ -425,22 +441,18 @@ static KObj *op_rand1(KObj *left, KObj *value) {
     size_t len = value->as.vector->length;
     KObj *res = create_vec(len);
     for (size_t i = 0; i < len; i++) {
-      KObj *nobj = &value->as.vector->items[i];
+      KObj *nobj = vector_get(value, i);
       if (!is_number(nobj)) {
+        release_object(nobj);
         release_object(res);
         return create_nil();
       }
-      int64_t n = as_int(nobj);
-      if (n < 0)
-        n = 0;
-      KObj *row = create_vec((size_t)n);
-      KObj *items = row->as.vector->items;
-      for (int64_t j = 0; j < n; j++) {
-        items[j].type = FLOAT;
-        items[j].ref_count = 1;
-        items[j].as.float_value = rng_double();
+      KObj *row = op_rand1(left, nobj);
+      release_object(nobj);
+      if (row->type == NIL) {
+        release_object(res);
+        return row;
       }
-      row->as.vector->length = (size_t)n;
       vector_append(res, row);
       release_object(row);
     }
@@ -451,13 +463,10 @@ static KObj *op_rand1(KObj *left, KObj *value) {
   int64_t n = as_int(value);
   if (n < 0)
     n = 0;
-  KObj *res = create_vec((size_t)n);
-  KObj *items = res->as.vector->items;
-  for (int64_t i = 0; i < n; i++) {
-    items[i].type = FLOAT;
-    items[i].ref_count = 1;
-    items[i].as.float_value = rng_double();
-  }
+  KObj *res = create_typed_vec(FLOAT, (size_t)n);
+  double *out = res->as.vector->floats;
+  for (int64_t i = 0; i < n; i++)
+    out[i] = rng_double();
   res->as.vector->length = (size_t)n;
   return res;
 }
@@ -471,13 +480,10 @@ static KObj *op_rand2(KObj *left, KObj *right) {
     n = 0;
   if (m <= 0 || n == 0)
     return create_vec(0);
-  KObj *res = create_vec((size_t)n);
-  KObj *items = res->as.vector->items;
-  for (int64_t i = 0; i < n; i++) {
-    items[i].type = INT;
-    items[i].ref_count = 1;
-    items[i].as.int_value = (int64_t)rng_bounded((uint64_t)m);
-  }
+  KObj *res = create_typed_vec(INT, (size_t)n);
+  int64_t *out = res->as.vector->ints;
+  for (int64_t i = 0; i < n; i++)
+    out[i] = (int64_t)rng_bounded((uint64_t)m);
   res->as.vector->length = (size_t)n;
   return res;
 }
@@ -618,6 +624,262 @@ static KObj *op_floor(KObj *left, KObj *value) {
   return create_nil();
 }
 
+typedef enum {
+  FLAT_NONE,
+  FLAT_ADD,
+  FLAT_SUB,
+  FLAT_MUL,
+  FLAT_DIV,
+  FLAT_MAX,
+  FLAT_MIN,
+  FLAT_LT,
+  FLAT_GT,
+  FLAT_EQ
+} FlatOp;
+
+static FlatOp flat_op(KObj *(*op)(KObj *, KObj *)) {
+  if (op == op_add)
+    return FLAT_ADD;
+  if (op == op_sub)
+    return FLAT_SUB;
+  if (op == op_mul)
+    return FLAT_MUL;
+  if (op == op_div)
+    return FLAT_DIV;
+  if (op == op_max)
+    return FLAT_MAX;
+  if (op == op_min)
+    return FLAT_MIN;
+  if (op == op_lt)
+    return FLAT_LT;
+  if (op == op_gt)
+    return FLAT_GT;
+  if (op == op_eq)
+    return FLAT_EQ;
+  return FLAT_NONE;
+}
+
+// A flat operand is an INT/FLOAT vector or scalar; scalars are broadcast
+// by walking them with step 0.
+typedef struct {
+  KType type;
+  const void *data;
+  size_t step;
+} FlatArg;
+
+static bool flat_arg(KObj *o, FlatArg *out) {
+  if (o->type == VECTOR) {
+    KVec *v = o->as.vector;
+    if (v->elem != INT && v->elem != FLOAT)
+      return false;
+    out->type = v->elem;
+    out->data = v->items;
+    out->step = 1;
+    return true;
+  }
+  if (o->type == INT) {
+    out->type = INT;
+    out->data = &o->as.int_value;
+    out->step = 0;
+    return true;
+  }
+  if (o->type == FLOAT) {
+    out->type = FLOAT;
+    out->data = &o->as.float_value;
+    out->step = 0;
+    return true;
+  }
+  return false;
+}
+
+static inline double flat_f(const FlatArg *a, size_t i) {
+  return a->type == INT ? (double)((const int64_t *)a->data)[i * a->step]
+                        : ((const double *)a->data)[i * a->step];
+}
+
+static void flat_int_kernel(FlatOp f, const int64_t *a, size_t sa,
+                            const int64_t *b, size_t sb, int64_t *out,
+                            size_t n) {
+  switch (f) {
+  case FLAT_ADD:
+    for (size_t i = 0; i < n; i++)
+      out[i] = a[i * sa] + b[i * sb];
+    break;
+  case FLAT_SUB:
+    for (size_t i = 0; i < n; i++)
+      out[i] = a[i * sa] - b[i * sb];
+    break;
+  case FLAT_MUL:
+    for (size_t i = 0; i < n; i++)
+      out[i] = a[i * sa] * b[i * sb];
+    break;
+  case FLAT_MAX:
+    for (size_t i = 0; i < n; i++)
+      out[i] = a[i * sa] > b[i * sb] ? a[i * sa] : b[i * sb];
+    break;
+  case FLAT_MIN:
+    for (size_t i = 0; i < n; i++)
+      out[i] = a[i * sa] < b[i * sb] ? a[i * sa] : b[i * sb];
+    break;
+  case FLAT_LT:
+    for (size_t i = 0; i < n; i++)
+      out[i] = a[i * sa] < b[i * sb];
+    break;
+  case FLAT_GT:
+    for (size_t i = 0; i < n; i++)
+      out[i] = a[i * sa] > b[i * sb];
+    break;
+  case FLAT_EQ:
+    for (size_t i = 0; i < n; i++)
+      out[i] = (double)a[i * sa] == (double)b[i * sb];
+    break;
+  default:
+    break;
+  }
+}
+
+static void flat_float_kernel(FlatOp f, const FlatArg *a, const FlatArg *b,
+                              void *out, size_t n) {
+  double *fo = (double *)out;
+  int64_t *io = (int64_t *)out;
+  switch (f) {
+  case FLAT_ADD:
+    for (size_t i = 0; i < n; i++)
+      fo[i] = flat_f(a, i) + flat_f(b, i);
+    break;
+  case FLAT_SUB:
+    for (size_t i = 0; i < n; i++)
+      fo[i] = flat_f(a, i) - flat_f(b, i);
+    break;
+  case FLAT_MUL:
+    for (size_t i = 0; i < n; i++)
+      fo[i] = flat_f(a, i) * flat_f(b, i);
+    break;
+  case FLAT_DIV:
+    for (size_t i = 0; i < n; i++)
+      fo[i] = flat_f(a, i) / flat_f(b, i);
+    break;
+  case FLAT_MAX:
+    for (size_t i = 0; i < n; i++) {
+      double x = flat_f(a, i), y = flat_f(b, i);
+      fo[i] = x > y ? x : y;
+    }
+    break;
+  case FLAT_MIN:
+    for (size_t i = 0; i < n; i++) {
+      double x = flat_f(a, i), y = flat_f(b, i);
+      fo[i] = x < y ? x : y;
+    }
+    break;
+  case FLAT_LT:
+    for (size_t i = 0; i < n; i++)
+      io[i] = flat_f(a, i) < flat_f(b, i);
+    break;
+  case FLAT_GT:
+    for (size_t i = 0; i < n; i++)
+      io[i] = flat_f(a, i) > flat_f(b, i);
+    break;
+  case FLAT_EQ:
+    for (size_t i = 0; i < n; i++)
+      io[i] = flat_f(a, i) == flat_f(b, i);
+    break;
+  default:
+    break;
+  }
+}
+
+// A flat 8-byte vector whose only reference belongs to the caller can
+// take a result of the same length in place, whatever its element type.
+static bool reusable(KObj *o, size_t n) {
+  if (o->type != VECTOR || o->ref_count != 1)
+    return false;
+  KVec *v = o->as.vector;
+  return (v->elem == INT || v->elem == FLOAT) && v->length == n && !v->base;
+}
+
+// Element-wise op over flat operands without boxing; NULL means the
+// generic per-element path must handle it. With reuse set, an operand
+// the caller owns exclusively is overwritten with the result.
+static KObj *flat_binary(KObj *left, KObj *right,
+                         KObj *(*op)(KObj *, KObj *), bool reuse) {
+  FlatOp f = flat_op(op);
+  FlatArg a, b;
+  if (f == FLAT_NONE || !flat_arg(left, &a) || !flat_arg(right, &b))
+    return NULL;
+  size_t n = left->type == VECTOR ? left->as.vector->length
+                                  : right->as.vector->length;
+  if (f == FLAT_DIV) {
+    // x%0 yields infinities, which only the boxed form can hold
+    for (size_t i = 0; i < (b.step ? n : 1); i++) {
+      if (flat_f(&b, i) == 0)
+        return NULL;
+    }
+  }
+  bool ints = a.type == INT && b.type == INT && f != FLAT_DIV;
+  bool cmp = f == FLAT_LT || f == FLAT_GT || f == FLAT_EQ;
+  KType out = ints || cmp ? INT : FLOAT;
+  KObj *res = NULL;
+  if (reuse && reusable(left, n))
+    res = left;
+  else if (reuse && reusable(right, n))
+    res = right;
+  if (res) {
+    // each kernel reads element i of both inputs before writing it
+    retain_object(res);
+    res->as.vector->elem = out;
+    res->as.vector->attr = 0;
+  } else {
+    res = create_typed_vec(out, n);
+  }
+  if (ints)
+    flat_int_kernel(f, (const int64_t *)a.data, a.step,
+                    (const int64_t *)b.data, b.step, res->as.vector->ints, n);
+  else
+    flat_float_kernel(f, &a, &b, res->as.vector->items, n);
+  res->as.vector->length = n;
+  if (cmp)
+    res->as.vector->attr = ATTR_BOOL;
+  return res;
+}
+
+// Scalar counterpart of flat_binary for INT/FLOAT atoms. The result goes
+// into an operand the caller owns exclusively when its type fits, so a
+// chain like (a*a)+b-1 allocates no intermediates.
+static KObj *scalar_binary(KObj *left, KObj *right,
+                           KObj *(*op)(KObj *, KObj *)) {
+  FlatOp f = flat_op(op);
+  FlatArg a, b;
+  if (f == FLAT_NONE || !flat_arg(left, &a) || !flat_arg(right, &b))
+    return NULL;
+  if (f == FLAT_DIV && flat_f(&b, 0) == 0)
+    return NULL;
+  bool ints = a.type == INT && b.type == INT && f != FLAT_DIV;
+  bool cmp = f == FLAT_LT || f == FLAT_GT || f == FLAT_EQ;
+  KType out = ints || cmp ? INT : FLOAT;
+  union {
+    int64_t i;
+    double f;
+  } r;
+  if (ints)
+    flat_int_kernel(f, (const int64_t *)a.data, 0, (const int64_t *)b.data, 0,
+                    &r.i, 1);
+  else
+    flat_float_kernel(f, &a, &b, &r, 1);
+  KObj *res = NULL;
+  if (left->ref_count == 1 && left->type == out)
+    res = left;
+  else if (right->ref_count == 1 && right->type == out)
+    res = right;
+  if (!res)
+    return out == INT ? create_int(r.i) : create_float(r.f);
+  retain_object(res);
+  if (out == INT)
+    res->as.int_value = r.i;
+  else
+    res->as.float_value = r.f;
+  return res;
+}
+
 KObj *k_add(KObj *left, KObj *right) {
   return apply_binary(left, right, op_add);
 }
@@ -678,7 +940,22 @@ KObj *k_randb(KObj *left, KObj *right) {
   return apply_binary(left, right, op_rand2);
 }
 
-KObj *k_floor(KObj *value) { return apply_binary(value, value, op_floor); }
+static void floor_flat(KVec *in, int64_t *out) {
+  for (size_t i = 0; i < in->length; i++)
+    out[i] = (int64_t)floor(in->floats[i]);
+}
+
+KObj *k_floor(KObj *value) {
+  if (value->type == VECTOR && value->as.vector->elem == FLOAT) {
+    KObj *res = create_typed_vec(INT, value->as.vector->length);
+    floor_flat(value->as.vector, res->as.vector->ints);
+    res->as.vector->length = value->as.vector->length;
+    return res;
+  }
+  if (value->type == VECTOR && value->as.vector->elem == INT)
+    return vector_copy(value);
+  return apply_binary(value, value, op_floor);
+}
 
 KObj *k_negate(KObj *value) {
   KObj *zero = create_float(0);
@@ -690,31 +967,50 @@ KObj *k_negate(KObj *value) {
 KObj *k_not(KObj *value) { return apply_binary(value, value, op_not); }
 
 static KObj *k_where_vector(KObj *vec) {
+  KVec *v = vec->as.vector;
+  size_t len = v->length;
+  if (is_virtual(vec) && v->elem == INT && v->by.i == 0 &&
+      v->from.i <= 1) {
+    // &n#0 is empty and &n#1 is !n
+    if (v->from.i <= 0)
+      return create_typed_vec(INT, 0);
+    KNum from = {.i = 0}, by = {.i = 1};
+    return create_range(INT, from, by, len);
+  }
+  int64_t *counts = (int64_t *)malloc(sizeof(int64_t) * (len ? len : 1));
   size_t total = 0;
-  for (size_t i = 0; i < vec->as.vector->length; i++) {
-    KObj *item = &vec->as.vector->items[i];
-    if (!is_number(item)) {
-      return create_nil();
+  int64_t most = 0;
+  for (size_t i = 0; i < len; i++) {
+    int64_t count;
+    if (v->elem == INT && v->items) {
+      count = v->ints[i];
+    } else {
+      KObj *item = vector_get(vec, i);
+      if (!is_number(item)) {
+        release_object(item);
+        free(counts);
+        return create_nil();
+      }
+      count = as_int(item);
+      release_object(item);
     }
-    int64_t count = as_int(item);
-    if (count > 0)
-      total += (size_t)count;
-  }
-  KObj *result = create_vec(total);
-  KObj *items = result->as.vector->items;
-  size_t pos = 0;
-  for (size_t i = 0; i < vec->as.vector->length; i++) {
-    int64_t count = as_int(&vec->as.vector->items[i]);
     if (count < 0)
       count = 0;
-    for (int64_t j = 0; j < count; j++) {
-      items[pos].type = INT;
-      items[pos].ref_count = 1;
-      items[pos].as.int_value = (int64_t)i;
-      pos++;
-    }
+    if (count > most)
+      most = count;
+    counts[i] = count;
+    total += (size_t)count;
+  }
+  KObj *result = create_typed_vec(INT, total);
+  int64_t *out = result->as.vector->ints;
+  size_t pos = 0;
+  for (size_t i = 0; i < len; i++) {
+    for (int64_t j = 0; j < counts[i]; j++)
+      out[pos++] = (int64_t)i;
   }
   result->as.vector->length = pos;
+  result->as.vector->attr = most > 1 ? ATTR_SORTED | ATTR_GROUPED : ATTR_ALL;
+  free(counts);
   return result;
 }
 
@@ -722,17 +1018,10 @@ static KObj *k_where_scalar(KObj *value) {
   if (!is_number(value))
     return create_nil();
   int64_t count = as_int(value);
-  if (count < 0)
-    count = 0;
-  KObj *result = create_vec((size_t)count);
-  KObj *items = result->as.vector->items;
-  for (int64_t i = 0; i < count; i++) {
-    items[i].type = INT;
-    items[i].ref_count = 1;
-    items[i].as.int_value = 0;
-  }
-  result->as.vector->length = (size_t)count;
-  return result;
+  if (count <= 0)
+    return create_typed_vec(INT, 0);
+  KNum zero = {.i = 0};
+  return create_range(INT, zero, zero, (size_t)count);
 }
 
 KObj *k_where(KObj *value) {
@@ -745,9 +1034,7 @@ KObj *k_first(KObj *value) {
       printf("^length\n");
       return create_nil();
     }
-    KObj *first = &value->as.vector->items[0];
-    retain_object(first);
-    return first;
+    return vector_get(value, 0);
   }
   if (value->type == DICT) {
     KObj *vals = value->as.dict->values;
@@ -755,9 +1042,7 @@ KObj *k_first(KObj *value) {
       printf("^length\n");
       return create_nil();
     }
-    KObj *first = &vals->as.vector->items[0];
-    retain_object(first);
-    return first;
+    return vector_get(vals, 0);
   }
   retain_object(value);
   return value;
@@ -772,8 +1057,11 @@ KObj *k_enlist(KObj *value) {
 static bool is_char_vector(KObj *obj) {
   if (obj->type != VECTOR)
     return false;
-  for (size_t i = 0; i < obj->as.vector->length; i++) {
-    if (obj->as.vector->items[i].type != CHAR)
+  KVec *v = obj->as.vector;
+  if (v->elem != NIL)
+    return v->elem == CHAR || v->length == 0;
+  for (size_t i = 0; i < v->length; i++) {
+    if (v->items[i]->type != CHAR)
       return false;
   }
   return true;
@@ -782,8 +1070,10 @@ static bool is_char_vector(KObj *obj) {
 static size_t compute_max_cols(KObj *value) {
   size_t rows = value->as.vector->length;
   size_t max_cols = 0;
+  if (value->as.vector->elem != NIL)
+    return rows ? 1 : 0;
   for (size_t r = 0; r < rows; r++) {
-    KObj *row = &value->as.vector->items[r];
+    KObj *row = value->as.vector->items[r];
     size_t len = (row->type == VECTOR) ? row->as.vector->length : 1;
     if (len > max_cols)
       max_cols = len;
@@ -794,11 +1084,10 @@ static size_t compute_max_cols(KObj *value) {
 static KObj *build_flip_row(KObj *value, size_t column, size_t rows) {
   KObj *new_row = create_vec(rows);
   for (size_t r = 0; r < rows; r++) {
-    KObj *row = &value->as.vector->items[r];
+    KObj *row = vector_get(value, r);
     if (row->type == VECTOR) {
       if (column < row->as.vector->length) {
-        KObj *item = &row->as.vector->items[column];
-        vector_append(new_row, item);
+        vector_append_from(new_row, row, column);
       } else {
         KObj *filler = is_char_vector(row) ? create_char(' ') : create_int(0);
         vector_append(new_row, filler);
@@ -807,6 +1096,7 @@ static KObj *build_flip_row(KObj *value, size_t column, size_t rows) {
     } else {
       vector_append(new_row, row);
     }
+    release_object(row);
   }
   return new_row;
 }
@@ -829,19 +1119,399 @@ KObj *k_flip(KObj *value) {
   return result;
 }
 
+// Copy n elements of the given size from src to dst in reverse order;
+// inlined with a constant size so each step is a plain load and store.
+static inline void rev_bytes(unsigned char *dst, const unsigned char *src,
+                             size_t n, size_t size) {
+  for (size_t i = 0; i < n; i++)
+    memcpy(dst + i * size, src + (n - 1 - i) * size, size);
+}
+
+static size_t rev_elem_size(KType elem) {
+  switch (elem) {
+  case INT:
+  case FLOAT:
+    return 8;
+  case CHAR:
+    return 1;
+  case SYM:
+    return sizeof(uint32_t);
+  default:
+    return sizeof(KObj *);
+  }
+}
+
+static void rev_into(KVec *dst, const KVec *src) {
+  unsigned char *d = (unsigned char *)dst->items;
+  const unsigned char *s = (const unsigned char *)src->items;
+  switch (rev_elem_size(src->elem)) {
+  case 8:
+    rev_bytes(d, s, src->length, 8);
+    break;
+  case 4:
+    rev_bytes(d, s, src->length, 4);
+    break;
+  default:
+    rev_bytes(d, s, src->length, 1);
+    break;
+  }
+}
+
+static void rev_in_place(KVec *v) {
+  size_t size = rev_elem_size(v->elem);
+  unsigned char *base = (unsigned char *)v->items;
+  unsigned char tmp[8];
+  for (size_t i = 0, j = v->length; i + 1 < j; i++, j--) {
+    memcpy(tmp, base + i * size, size);
+    memcpy(base + i * size, base + (j - 1) * size, size);
+    memcpy(base + (j - 1) * size, tmp, size);
+  }
+}
+
 KObj *k_rev(KObj *value) {
   if (value->type != VECTOR) {
     retain_object(value);
     return value;
   }
-  size_t len = value->as.vector->length;
-  KObj *result = create_vec(len);
-  for (size_t i = 0; i < len; i++) {
-    KObj *item = &value->as.vector->items[len - i - 1];
-    vector_append(result, item);
+  KVec *v = value->as.vector;
+  if (v->length == 0)
+    return create_vec(0);
+  if (is_virtual(value) && v->elem == INT) {
+    KNum last = {.i = (int64_t)((uint64_t)v->from.i +
+                                (uint64_t)(v->length - 1) * (uint64_t)v->by.i)};
+    KNum by = {.i = (int64_t)(0 - (uint64_t)v->by.i)};
+    return create_range(INT, last, by, v->length);
+  }
+  vector_force(value);
+  KObj *result = create_typed_vec(v->elem, v->length);
+  rev_into(result->as.vector, v);
+  result->as.vector->length = v->length;
+  result->as.vector->attr =
+      v->attr & (ATTR_UNIQUE | ATTR_GROUPED | ATTR_BOOL);
+  if (v->elem == NIL) {
+    for (size_t i = 0; i < v->length; i++)
+      retain_object(v->items[i]);
   }
   return result;
 }
+
+// An op between a virtual vector and an atom whose result is again
+// virtual: any op on a constant fill, and + - * between an INT progression
+// and an INT atom. NULL when the result needs storage.
+static KObj *virtual_binary(KObj *left, KObj *right,
+                           KObj *(*op)(KObj *, KObj *)) {
+  KObj *vec = is_virtual(left) ? left : right;
+  KObj *atom = vec == left ? right : left;
+  if (atom->type != INT && atom->type != FLOAT)
+    return NULL;
+  KVec *v = vec->as.vector;
+  if (v->by.i == 0) {
+    KObj fill = {.type = v->elem, .ref_count = K_IMMORTAL};
+    if (v->elem == INT)
+      fill.as.int_value = v->from.i;
+    else
+      fill.as.float_value = v->from.f;
+    KObj *r = vec == left ? op(&fill, atom) : op(atom, &fill);
+    KObj *res = NULL;
+    if (r->type == INT || r->type == FLOAT)
+      res = create_range(r->type, num_of(r), v->by, v->length);
+    release_object(r);
+    return res;
+  }
+  if (v->elem != INT || atom->type != INT)
+    return NULL;
+  uint64_t from = (uint64_t)v->from.i, by = (uint64_t)v->by.i;
+  uint64_t s = (uint64_t)atom->as.int_value;
+  if (op == op_add) {
+    from += s;
+  } else if (op == op_sub && vec == left) {
+    from -= s;
+  } else if (op == op_sub) {
+    from = s - from;
+    by = -by;
+  } else if (op == op_mul) {
+    from *= s;
+    by *= s;
+  } else {
+    return NULL;
+  }
+  KNum f = {.i = (int64_t)from}, b = {.i = (int64_t)by};
+  return create_range(INT, f, b, v->length);
+}
+
+static BinaryFunc const owned_binary[] = {k_add, k_sub, k_mul, k_div, k_max,
+                                          k_min, k_less, k_more, k_eq};
+static KObj *(*const owned_op[])(KObj *, KObj *) = {
+    op_add, op_sub, op_mul, op_div, op_max, op_min, op_lt, op_gt, op_eq};
+
+// Like fn(left, right), for a caller that drops its references to left
+// and right right after the call: an operand nobody else references
+// (ref_count 1) may be overwritten with the result instead of allocating.
+KObj *k_binary_owned(BinaryFunc fn, KObj *left, KObj *right) {
+  if (is_virtual(left) || is_virtual(right)) {
+    for (size_t i = 0; i < sizeof(owned_op) / sizeof(*owned_op); i++) {
+      if (owned_binary[i] != fn)
+        continue;
+      KObj *res = virtual_binary(left, right, owned_op[i]);
+      if (res)
+        return res;
+      break;
+    }
+    // n#x and n_x slice virtual vectors without storing them
+    if (!((fn == k_take || fn == k_drop) && left->type == INT)) {
+      vector_force(left);
+      vector_force(right);
+    }
+  }
+  bool vec = left->type == VECTOR || right->type == VECTOR;
+  bool same_len = left->type != VECTOR || right->type != VECTOR ||
+                  left->as.vector->length == right->as.vector->length;
+  for (size_t i = 0; same_len && i < sizeof(owned_op) / sizeof(*owned_op);
+       i++) {
+    if (owned_binary[i] != fn)
+      continue;
+    KObj *res = vec ? flat_binary(left, right, owned_op[i], true)
+                    : scalar_binary(left, right, owned_op[i]);
+    if (res)
+      return res;
+    break;
+  }
+  return fn(left, right);
+}
+
+// Unary counterpart of k_binary_owned for reverse, floor and negate.
+KObj *k_unary_owned(UnaryFunc fn, KObj *value) {
+  if (is_virtual(value)) {
+    if (fn == k_count || fn == k_first || fn == k_where)
+      return fn(value);
+    vector_force(value);
+  }
+  if (value->type != VECTOR || value->ref_count != 1 ||
+      value->as.vector->base)
+    return fn(value);
+  KVec *v = value->as.vector;
+  if (fn == k_rev) {
+    rev_in_place(v);
+    v->attr &= ATTR_UNIQUE | ATTR_GROUPED | ATTR_BOOL;
+    retain_object(value);
+    return value;
+  }
+  if (fn == k_floor && (v->elem == INT || v->elem == FLOAT)) {
+    if (v->elem == FLOAT) {
+      floor_flat(v, v->ints);
+      // floor never reorders, but it can merge neighbours
+      v->attr = v->attr & ATTR_SORTED ? ATTR_SORTED | ATTR_GROUPED : 0;
+    }
+    v->elem = INT;
+    retain_object(value);
+    return value;
+  }
+  if (fn == k_negate && (v->elem == INT || v->elem == FLOAT)) {
+    KObj *zero = create_float(0);
+    KObj *res = flat_binary(zero, value, op_sub, true);
+    release_object(zero);
+    return res;
+  }
+  return fn(value);
+}
+
+// Verbs k_fused runs: the binary ones flat_binary has kernels for, and
+// these unary ones.
+static FlatOp fused_binary(BinaryFunc fn) {
+  for (size_t i = 0; i < sizeof(owned_op) / sizeof(*owned_op); i++) {
+    if (owned_binary[i] == fn)
+      return flat_op(owned_op[i]);
+  }
+  return FLAT_NONE;
+}
+
+static bool fused_unary(UnaryFunc fn) {
+  return fn == k_negate || fn == k_sin || fn == k_cos || fn == k_abs ||
+         fn == k_sqrt;
+}
+
+bool fused_verb(ASTNode *n) {
+  if (n->type == AST_UNARY)
+    return fused_unary(get_op_desc(n->as.unary.op.type)->unary);
+  return n->type == AST_BINARY &&
+         fused_binary(get_op_desc(n->as.binary.op.type)->binary) != FLAT_NONE;
+}
+
+#define FUSE_BLOCK 512
+
+// A fused tree being run: its nodes are numbered in the order they are
+// visited, node before children and left before right.
+typedef struct {
+  KObj **vars;
+  KObj *leaf[FUSED_MAX];  // value of each leaf node
+  KType type[FUSED_MAX];  // type of each node's items
+  size_t len;             // length of the list operands
+  size_t node, var;       // counters while visiting
+  int64_t (*buf)[FUSE_BLOCK]; // one block of items per node
+} Fused;
+
+// Checks the values under n and types its nodes; false when they do not
+// suit a fused loop.
+static bool fuse_check(Fused *f, ASTNode *n) {
+  size_t id = f->node++;
+  if (n->type == AST_VAR || n->type == AST_LITERAL) {
+    KObj *o = n->type == AST_VAR ? f->vars[f->var++] : n->as.literal.value;
+    f->leaf[id] = o;
+    if (o->type == INT || o->type == FLOAT) {
+      f->type[id] = o->type;
+      return true;
+    }
+    if (o->type != VECTOR)
+      return false;
+    KVec *v = o->as.vector;
+    if ((v->elem != INT && v->elem != FLOAT) || v->length == 0 ||
+        (f->len && f->len != v->length))
+      return false;
+    f->len = v->length;
+    f->type[id] = v->elem;
+    return true;
+  }
+  if (n->type == AST_UNARY) {
+    if (!fuse_check(f, n->as.unary.child))
+      return false;
+    UnaryFunc fn = get_op_desc(n->as.unary.op.type)->unary;
+    f->type[id] = fn == k_abs ? f->type[id + 1] : FLOAT;
+    return true;
+  }
+  size_t left = f->node;
+  if (!fuse_check(f, n->as.binary.left))
+    return false;
+  size_t right = f->node;
+  if (!fuse_check(f, n->as.binary.right))
+    return false;
+  FlatOp op = fused_binary(get_op_desc(n->as.binary.op.type)->binary);
+  bool ints = f->type[left] == INT && f->type[right] == INT && op != FLAT_DIV;
+  bool cmp = op == FLAT_LT || op == FLAT_GT || op == FLAT_EQ;
+  f->type[id] = ints || cmp ? INT : FLOAT;
+  return true;
+}
+
+// Items from..from+n of n, into out when it is given, else into the node's
+// own block unless a leaf's items can be read where they are. False when
+// an item is one the verbs only give in boxed form, such as x%0.
+static bool fuse_block(Fused *f, ASTNode *n, size_t from, size_t count,
+                       void *out, FlatArg *res) {
+  size_t id = f->node++;
+  res->type = f->type[id];
+  res->step = 1;
+  if (n->type == AST_VAR || n->type == AST_LITERAL) {
+    KObj *o = f->leaf[id];
+    if (o->type != VECTOR) {
+      res->data = o->type == INT ? (const void *)&o->as.int_value
+                                 : (const void *)&o->as.float_value;
+      res->step = 0;
+      return true;
+    }
+    KVec *v = o->as.vector;
+    if (v->items) {
+      res->data = v->ints + from;
+      return true;
+    }
+    // a virtual list is worked out a block at a time, like def.c does
+    int64_t *ints = f->buf[id];
+    double *floats = (double *)f->buf[id];
+    for (size_t i = 0; i < count; i++) {
+      if (v->elem == INT)
+        ints[i] = (int64_t)((uint64_t)v->from.i +
+                            (uint64_t)(from + i) * (uint64_t)v->by.i);
+      else
+        floats[i] = v->by.f == 0 ? v->from.f
+                                 : v->from.f + (double)(from + i) * v->by.f;
+    }
+    res->data = ints;
+    return true;
+  }
+  void *dst = out ? out : f->buf[id];
+  res->data = dst;
+  FlatArg a, b;
+  if (n->type == AST_UNARY) {
+    if (!fuse_block(f, n->as.unary.child, from, count, NULL, &a))
+      return false;
+    UnaryFunc fn = get_op_desc(n->as.unary.op.type)->unary;
+    int64_t *io = (int64_t *)dst;
+    double *fo = (double *)dst;
+    if (fn == k_abs && a.type == INT) {
+      const int64_t *ai = (const int64_t *)a.data;
+      for (size_t i = 0; i < count; i++) {
+        int64_t x = ai[i * a.step];
+        io[i] = x < 0 ? -x : x;
+      }
+    } else if (fn == k_abs) {
+      for (size_t i = 0; i < count; i++)
+        fo[i] = fabs(flat_f(&a, i));
+    } else if (fn == k_negate) {
+      for (size_t i = 0; i < count; i++)
+        fo[i] = 0.0 - flat_f(&a, i);
+    } else if (fn == k_sin) {
+      for (size_t i = 0; i < count; i++)
+        fo[i] = sin(flat_f(&a, i));
+    } else if (fn == k_cos) {
+      for (size_t i = 0; i < count; i++)
+        fo[i] = cos(flat_f(&a, i));
+    } else {
+      for (size_t i = 0; i < count; i++) {
+        double x = flat_f(&a, i);
+        if (x < 0)
+          return false;
+        fo[i] = sqrt(x);
+      }
+    }
+    return true;
+  }
+  if (!fuse_block(f, n->as.binary.left, from, count, NULL, &a) ||
+      !fuse_block(f, n->as.binary.right, from, count, NULL, &b))
+    return false;
+  FlatOp op = fused_binary(get_op_desc(n->as.binary.op.type)->binary);
+  if (op == FLAT_DIV) {
+    for (size_t i = 0; i < (b.step ? count : 1); i++) {
+      if (flat_f(&b, i) == 0)
+        return false;
+    }
+  }
+  if (a.type == INT && b.type == INT && op != FLAT_DIV)
+    flat_int_kernel(op, (const int64_t *)a.data, a.step,
+                    (const int64_t *)b.data, b.step, (int64_t *)dst, count);
+  else
+    flat_float_kernel(op, &a, &b, dst, count);
+  return true;
+}
+
+KObj *k_fused(ASTNode *n, KObj **vars) {
+  Fused f = {.vars = vars};
+  if (!fuse_check(&f, n) || !f.len)
+    return NULL;
+  size_t nodes = f.node;
+  f.buf = (int64_t(*)[FUSE_BLOCK])malloc(nodes * sizeof(*f.buf));
+  if (!f.buf)
+    return NULL;
+  KObj *res = create_typed_vec(f.type[0], f.len);
+  KVec *rv = res->as.vector;
+  bool ok = true;
+  for (size_t from = 0; ok && from < f.len; from += FUSE_BLOCK) {
+    size_t count = f.len - from < FUSE_BLOCK ? f.len - from : FUSE_BLOCK;
+    FlatArg out;
+    f.node = 0;
+    f.var = 0;
+    ok = fuse_block(&f, n, from, count, rv->ints + from, &out);
+  }
+  free(f.buf);
+  if (!ok) {
+    release_object(res);
+    return NULL;
+  }
+  rv->length = f.len;
+  if (n->type == AST_BINARY) {
+    FlatOp op = fused_binary(get_op_desc(n->as.binary.op.type)->binary);
+    if (op == FLAT_LT || op == FLAT_GT || op == FLAT_EQ)
+      rv->attr = ATTR_BOOL;
+  }
+  return res;
+}
 static int asc_cmp(KObj *a, KObj *b, bool *domain) {
   if (is_number(a) && is_number(b)) {
     if (a->type == PINF || b->type == NINF)
@@ -866,16 +1536,18 @@ static int asc_cmp(KObj *a, KObj *b, bool *domain) {
     return 0;
   }
   if (a->type == SYM && b->type == SYM) {
-    int c = strcmp(a->as.symbol_value, b->as.symbol_value);
-    return c < 0 ? -1 : (c > 0);
+    return sym_cmp(a->as.symbol_value, b->as.symbol_value);
   }
   if (a->type == VECTOR && b->type == VECTOR) {
     size_t alen = a->as.vector->length;
     size_t blen = b->as.vector->length;
     size_t n = alen < blen ? alen : blen;
     for (size_t i = 0; i < n; i++) {
-      int cmp =
-          asc_cmp(&a->as.vector->items[i], &b->as.vector->items[i], domain);
+      KObj *ai = vector_get(a, i);
+      KObj *bi = vector_get(b, i);
+      int cmp = asc_cmp(ai, bi, domain);
+      release_object(ai);
+      release_object(bi);
       if (*domain)
         return 0;
       if (cmp != 0)
@@ -891,6 +1563,25 @@ static int asc_cmp(KObj *a, KObj *b, bool *domain) {
   return 0;
 }
 
+// Order of elements a and b of v; boxed elements are passed in elems.
+static int idx_cmp(KVec *v, KObj **elems, size_t a, size_t b, bool *domain) {
+  switch (v->elem) {
+  case INT:
+    return (v->ints[a] > v->ints[b]) - (v->ints[a] < v->ints[b]);
+  case FLOAT:
+    return (v->floats[a] > v->floats[b]) - (v->floats[a] < v->floats[b]);
+  case CHAR: {
+    unsigned char ca = (unsigned char)v->chars[a];
+    unsigned char cb = (unsigned char)v->chars[b];
+    return (ca > cb) - (ca < cb);
+  }
+  case SYM:
+    return sym_cmp(sym_name(v->syms[a]), sym_name(v->syms[b]));
+  default:
+    return asc_cmp(elems[a], elems[b], domain);
+  }
+}
+
 KObj *k_asc(KObj *value) {
   if (value->type != VECTOR) {
     KObj *result = create_vec(1);
@@ -903,21 +1594,33 @@ KObj *k_asc(KObj *value) {
   if (len == 0) {
     return create_vec(0);
   }
-  KObj *items = value->as.vector->items;
-  KType first_type = items[0].type;
-  int first_num = is_number(&items[0]);
-  for (size_t i = 1; i < len; i++) {
-    if (first_num) {
-      if (!is_number(&items[i])) {
-        printf("^domain\n");
-        return create_nil();
-      }
-    } else {
-      if (items[i].type != first_type) {
-        printf("^domain\n");
-        return create_nil();
+  KVec *v = value->as.vector;
+  if (v->attr & ATTR_SORTED) {
+    // the stable grade of ordered items is the identity
+    KNum from = {.i = 0}, by = {.i = 1};
+    return create_range(INT, from, by, len);
+  }
+  KObj **elems = NULL;
+  if (v->elem == NIL) {
+    KObj **items = v->items;
+    KType first_type = items[0]->type;
+    int first_num = is_number(items[0]);
+    for (size_t i = 1; i < len; i++) {
+      if (first_num) {
+        if (!is_number(items[i])) {
+          printf("^domain\n");
+          return create_nil();
+        }
+      } else {
+        if (items[i]->type != first_type) {
+          printf("^domain\n");
+          return create_nil();
+        }
       }
     }
+    elems = (KObj **)malloc(sizeof(KObj *) * len);
+    for (size_t i = 0; i < len; i++)
+      elems[i] = items[i];
   }
   size_t *idxs = (size_t *)malloc(sizeof(size_t) * len);
   for (size_t i = 0; i < len; i++)
@@ -926,6 +1629,7 @@ KObj *k_asc(KObj *value) {
   size_t *tmp = (size_t *)malloc(sizeof(size_t) * len);
   if (!tmp) {
     free(idxs);
+    free(elems);
     printf("^oom\n");
     return create_nil();
   }
@@ -936,7 +1640,7 @@ KObj *k_asc(KObj *value) {
       size_t right = (i + 2 * width < len) ? (i + 2 * width) : len;
       size_t p = left, q = mid, t = left;
       while (p < mid && q < right) {
-        int c = asc_cmp(&items[idxs[p]], &items[idxs[q]], &domain);
+        int c = idx_cmp(v, elems, idxs[p], idxs[q], &domain);
         if (domain)
           break;
         if (c < 0 || (c == 0 && idxs[p] <= idxs[q])) {
@@ -958,39 +1662,47 @@ KObj *k_asc(KObj *value) {
       break;
   }
   free(tmp);
+  free(elems);
   if (domain) {
     free(idxs);
     printf("^domain\n");
     return create_nil();
   }
-  KObj *result = create_vec(len);
-  for (size_t i = 0; i < len; i++) {
-    KObj *idx = create_int((int64_t)idxs[i]);
-    vector_append(result, idx);
-    release_object(idx);
-  }
+  KObj *result = create_typed_vec(INT, len);
+  int64_t *out = result->as.vector->ints;
+  for (size_t i = 0; i < len; i++)
+    out[i] = (int64_t)idxs[i];
+  result->as.vector->length = len;
+  result->as.vector->attr = ATTR_UNIQUE | ATTR_GROUPED;
   free(idxs);
   return result;
 }
 
-KObj *k_desc(KObj *value) { return k_rev(k_asc(value)); }
+KObj *k_desc(KObj *value) {
+  KObj *idxs = k_asc(value);
+  KObj *result = k_rev(idxs);
+  release_object(idxs);
+  return result;
+}
 
 KObj *k_sort(KObj *value) {
+  if (value->type == VECTOR && value->as.vector->attr & ATTR_SORTED) {
+    retain_object(value);
+    return value;
+  }
   if (value->type == VECTOR) {
     size_t len = value->as.vector->length;
     KObj *idxs = k_asc(value);
     if (idxs->type == NIL)
       return idxs;
     KObj *res = create_vec(len);
-    for (size_t i = 0; i < len; i++) {
-      KObj *idx = &idxs->as.vector->items[i];
-      size_t id = (size_t)idx->as.int_value;
-      vector_append(res, &value->as.vector->items[id]);
-    }
+    for (size_t i = 0; i < len; i++)
+      vector_append_from(res, value, (size_t)idxs->as.vector->ints[i]);
     release_object(idxs);
     return res;
   }
-  if (value->type == DICT) {
+  if (value->type == DICT && !(value->as.dict->keys->as.vector->attr &
+                                ATTR_SORTED)) {
     KObj *keys = value->as.dict->keys;
     KObj *vals = value->as.dict->values;
     size_t len = keys->as.vector->length;
@@ -1000,10 +1712,9 @@ KObj *k_sort(KObj *value) {
     KObj *sk = create_vec(len);
     KObj *sv = create_vec(len);
     for (size_t i = 0; i < len; i++) {
-      KObj *idx = &idxs->as.vector->items[i];
-      size_t id = (size_t)idx->as.int_value;
-      vector_append(sk, &keys->as.vector->items[id]);
-      vector_append(sv, &vals->as.vector->items[id]);
+      size_t id = (size_t)idxs->as.vector->ints[i];
+      vector_append_from(sk, keys, id);
+      vector_append_from(sv, vals, id);
     }
     release_object(idxs);
     KObj *dict = create_dict(sk, sv);
@@ -1024,7 +1735,7 @@ static bool eq_bool(KObj *left, KObj *right) {
     return as_double(left) == as_double(right);
   }
   if (left->type == SYM && right->type == SYM) {
-    return strcmp(left->as.symbol_value, right->as.symbol_value) == 0;
+    return left->as.symbol_value == right->as.symbol_value;
   }
   if (left->type == right->type) {
     if (left->type == NIL)
@@ -1043,15 +1754,6 @@ static uint64_t mix64(uint64_t x) {
   return x;
 }
 
-static uint64_t hash_str64(const char *s) {
-  uint64_t h = 1469598103934665603ULL;
-  while (*s) {
-    h ^= (unsigned char)(*s++);
-    h *= 1099511628211ULL;
-  }
-  return h;
-}
-
 static uint64_t hash_obj(KObj *o) {
   switch (o->type) {
   case INT: {
@@ -1088,12 +1790,73 @@ static uint64_t hash_obj(KObj *o) {
   case NINF:
     return 0xfff0000000000001ULL;
   case SYM:
-    return mix64(hash_str64(o->as.symbol_value));
+    return mix64(sym_hash(o->as.symbol_value));
   default:
     return mix64((uintptr_t)o);
   }
 }
 
+static uint64_t hash_flat(KVec *v, size_t i) {
+  KObj item;
+  item.type = v->elem;
+  switch (v->elem) {
+  case SYM:
+    return mix64(sym_hash(sym_name(v->syms[i])));
+  case INT:
+    item.as.int_value = v->ints[i];
+    break;
+  case FLOAT:
+    item.as.float_value = v->floats[i];
+    break;
+  default:
+    item.as.char_value = v->chars[i];
+    break;
+  }
+  return hash_obj(&item);
+}
+
+static bool eq_flat(KVec *v, size_t a, size_t b) {
+  switch (v->elem) {
+  case INT:
+    return v->ints[a] == v->ints[b];
+  case FLOAT:
+    return v->floats[a] == v->floats[b];
+  case SYM:
+    return v->syms[a] == v->syms[b];
+  default:
+    return v->chars[a] == v->chars[b];
+  }
+}
+
+// =x for a flat vector whose equal items are adjacent: the groups are its
+// runs, found without hashing.
+static KObj *group_runs(KObj *vec) {
+  KVec *v = vec->as.vector;
+  size_t runs = 0;
+  for (size_t i = 0; i < v->length; i++)
+    runs += i == 0 || !eq_flat(v, i - 1, i);
+  KObj *keys = create_vec(runs);
+  KObj *vals = create_vec(runs);
+  for (size_t i = 0, j; i < v->length; i = j) {
+    for (j = i + 1; j < v->length && eq_flat(v, i, j); j++)
+      ;
+    vector_append_from(keys, vec, i);
+    KObj *idxs = create_typed_vec(INT, j - i);
+    for (size_t k = i; k < j; k++)
+      idxs->as.vector->ints[k - i] = (int64_t)k;
+    idxs->as.vector->length = j - i;
+    idxs->as.vector->attr = ATTR_ALL;
+    vector_append(vals, idxs);
+    release_object(idxs);
+  }
+  if (keys->as.vector->elem != NIL)
+    keys->as.vector->attr |= ATTR_UNIQUE | ATTR_GROUPED;
+  KObj *dict = create_dict(keys, vals);
+  release_object(keys);
+  release_object(vals);
+  return dict;
+}
+
 KObj *k_group(KObj *value) {
   KObj *vec = value;
   int created = 0;
@@ -1102,64 +1865,89 @@ KObj *k_group(KObj *value) {
     vector_append(vec, value);
     created = 1;
   }
-  for (size_t i = 0; i < vec->as.vector->length; i++) {
-    if (vec->as.vector->items[i].type == VECTOR) {
-      if (created)
-        release_object(vec);
-      printf("^rank\n");
-      return create_nil();
+  KVec *v = vec->as.vector;
+  if (v->elem == NIL) {
+    for (size_t i = 0; i < v->length; i++) {
+      if (v->items[i]->type == VECTOR) {
+        if (created)
+          release_object(vec);
+        printf("^rank\n");
+        return create_nil();
+      }
     }
   }
-  KObj *keys = create_vec(8);
-  KObj *vals = create_vec(8);
-  size_t n = vec->as.vector->length;
+  if (v->elem != NIL && v->items && v->attr & ATTR_GROUPED) {
+    KObj *dict = group_runs(vec);
+    if (created)
+      release_object(vec);
+    return dict;
+  }
+  size_t n = v->length;
   size_t cap = 1;
   while (cap < (n ? (n << 1) : 1))
     cap <<= 1;
   size_t *map = (size_t *)malloc(sizeof(size_t) * cap);
-  if (!map) {
+  // first[g] is the position where group g first appears, gid[i] the
+  // group of element i; the index lists are filled in a second pass.
+  size_t *first = (size_t *)malloc(sizeof(size_t) * (n ? n : 1));
+  size_t *gid = (size_t *)malloc(sizeof(size_t) * (n ? n : 1));
+  size_t *count = (size_t *)calloc(n ? n : 1, sizeof(size_t));
+  if (!map || !first || !gid || !count) {
     if (created)
       release_object(vec);
-    release_object(keys);
-    release_object(vals);
+    free(map);
+    free(first);
+    free(gid);
+    free(count);
     printf("^oom\n");
     return create_nil();
   }
   for (size_t i = 0; i < cap; i++)
     map[i] = SIZE_MAX;
 
+  size_t groups = 0;
   for (size_t i = 0; i < n; i++) {
-    KObj *item = &vec->as.vector->items[i];
-    uint64_t h = hash_obj(item);
+    bool flat = v->elem != NIL;
+    KObj *item = flat ? NULL : v->items[i];
+    uint64_t h = flat ? hash_flat(v, i) : hash_obj(item);
     size_t p = (size_t)(h & (cap - 1));
     size_t slot;
     for (;;) {
       slot = map[p];
       if (slot == SIZE_MAX)
         break;
-      KObj *key = &keys->as.vector->items[slot];
-      if (eq_bool(item, key))
+      if (flat ? eq_flat(v, i, first[slot])
+               : eq_bool(item, v->items[first[slot]]))
         break;
       p = (p + 1) & (cap - 1);
     }
-    if (slot != SIZE_MAX) {
-      KObj *idxs = &vals->as.vector->items[slot];
-      KObj *idx = create_int((int64_t)i);
-      vector_append(idxs, idx);
-      release_object(idx);
-    } else {
-      size_t new_index = keys->as.vector->length;
-      vector_append(keys, item);
-      KObj *idxs = create_vec(1);
-      KObj *idx = create_int((int64_t)i);
-      vector_append(idxs, idx);
-      release_object(idx);
-      vector_append(vals, idxs);
-      release_object(idxs);
-      map[p] = new_index;
+    if (slot == SIZE_MAX) {
+      slot = groups++;
+      first[slot] = i;
+      map[p] = slot;
     }
+    gid[i] = slot;
+    count[slot]++;
   }
   free(map);
+  KObj *keys = create_vec(groups);
+  KObj *vals = create_vec(groups);
+  for (size_t g = 0; g < groups; g++) {
+    vector_append_from(keys, vec, first[g]);
+    KObj *idxs = create_typed_vec(INT, count[g]);
+    idxs->as.vector->attr = ATTR_ALL; // filled in ascending order below
+    vector_append(vals, idxs);
+    release_object(idxs);
+  }
+  for (size_t i = 0; i < n; i++) {
+    KVec *idxs = vals->as.vector->items[gid[i]]->as.vector;
+    idxs->ints[idxs->length++] = (int64_t)i;
+  }
+  if (keys->as.vector->elem != NIL)
+    keys->as.vector->attr |= ATTR_UNIQUE | ATTR_GROUPED;
+  free(first);
+  free(gid);
+  free(count);
   KObj *dict = create_dict(keys, vals);
   release_object(keys);
   release_object(vals);
@@ -1169,9 +1957,203 @@ KObj *k_group(KObj *value) {
   return dict;
 }
 
+// Dicts of up to DICT_SCAN_MAX keys are searched directly, and dicts with
+// sorted keys by bisection. Others get an open-addressing table of key positions + 1 (0 is an empty slot),
+// kept at most half full; a repeated key resolves to its first position.
+#define DICT_SCAN_MAX 8
+
+static uint64_t hash_key(KVec *keys, size_t i) {
+  return keys->elem == NIL ? hash_obj(keys->items[i]) : hash_flat(keys, i);
+}
+
+// Keys match only within a type, so that equal keys always hash alike.
+static bool same_key(KObj *a, KObj *b) {
+  if (a->type != b->type)
+    return false;
+  switch (a->type) {
+  case INT:
+    return a->as.int_value == b->as.int_value;
+  case FLOAT:
+    return a->as.float_value == b->as.float_value;
+  case CHAR:
+    return a->as.char_value == b->as.char_value;
+  default:
+    return eq_bool(a, b);
+  }
+}
+
+static bool key_eq(KVec *keys, size_t i, KObj *key) {
+  switch (keys->elem) {
+  case NIL:
+    return same_key(keys->items[i], key);
+  case INT:
+    return key->type == INT && keys->ints[i] == key->as.int_value;
+  case FLOAT:
+    return key->type == FLOAT && keys->floats[i] == key->as.float_value;
+  case SYM:
+    return key->type == SYM && keys->syms[i] == sym_id(key->as.symbol_value);
+  default:
+    return key->type == CHAR && keys->chars[i] == key->as.char_value;
+  }
+}
+
+// Whether keys[i] sorts before key, which has the keys' element type.
+static bool key_before(KVec *keys, size_t i, KObj *key) {
+  switch (keys->elem) {
+  case INT:
+    return keys->ints[i] < key->as.int_value;
+  case FLOAT:
+    return keys->floats[i] < key->as.float_value;
+  case SYM:
+    return sym_cmp(sym_name(keys->syms[i]), key->as.symbol_value) < 0;
+  default:
+    return (unsigned char)keys->chars[i] < (unsigned char)key->as.char_value;
+  }
+}
+
+// Binary search of sorted flat keys for the first position holding key.
+static size_t sorted_find(KVec *keys, KObj *key) {
+  if (key->type != keys->elem)
+    return SIZE_MAX;
+  size_t lo = 0, hi = keys->length;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (key_before(keys, mid, key))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < keys->length && key_eq(keys, lo, key) ? lo : SIZE_MAX;
+}
+
+static bool dict_index(KDict *d) {
+  KVec *keys = d->keys->as.vector;
+  size_t n = keys->length;
+  size_t cap = 16;
+  while (cap < n * 2)
+    cap <<= 1;
+  size_t *slots = (size_t *)calloc(cap, sizeof(size_t));
+  if (!slots)
+    return false;
+  for (size_t i = 0; i < n; i++) {
+    size_t p = (size_t)(hash_key(keys, i) & (cap - 1));
+    for (; slots[p]; p = (p + 1) & (cap - 1)) {
+      size_t j = slots[p] - 1;
+      if (keys->elem == NIL ? same_key(keys->items[i], keys->items[j])
+                            : eq_flat(keys, i, j))
+        break;
+    }
+    if (!slots[p])
+      slots[p] = i + 1;
+  }
+  d->index = slots;
+  d->slots = cap;
+  return true;
+}
+
+// Position of key in dict's keys, or SIZE_MAX when it is absent.
+size_t dict_find(KObj *dict, KObj *key) {
+  KDict *d = dict->as.dict;
+  KVec *keys = d->keys->as.vector;
+  KObj probe;
+  if (keys->elem == FLOAT && key->type == INT) {
+    probe.type = FLOAT;
+    probe.as.float_value = (double)key->as.int_value;
+    key = &probe;
+  } else if (keys->elem == INT && key->type == FLOAT) {
+    double f = key->as.float_value;
+    if (!(f >= -9.2e18 && f <= 9.2e18 && f == (double)(int64_t)f))
+      return SIZE_MAX;
+    probe.type = INT;
+    probe.as.int_value = (int64_t)f;
+    key = &probe;
+  }
+  // sorted keys need no index
+  if (!d->index && keys->attr & ATTR_SORTED)
+    return sorted_find(keys, key);
+  if (!d->index && (keys->length <= DICT_SCAN_MAX || !dict_index(d))) {
+    for (size_t i = 0; i < keys->length; i++) {
+      if (key_eq(keys, i, key))
+        return i;
+    }
+    return SIZE_MAX;
+  }
+  size_t mask = d->slots - 1;
+  for (size_t p = (size_t)(hash_obj(key) & mask); d->index[p];
+       p = (p + 1) & mask) {
+    if (key_eq(keys, d->index[p] - 1, key))
+      return d->index[p] - 1;
+  }
+  return SIZE_MAX;
+}
+
+// d[k] and d[ks]. An absent key gives 0, as an out-of-range index does.
+KObj *dict_get(KObj *dict, KObj *key) {
+  KObj *vals = dict->as.dict->values;
+  if (key->type != VECTOR) {
+    size_t i = dict_find(dict, key);
+    return i == SIZE_MAX ? create_int(0) : vector_get(vals, i);
+  }
+  size_t n = key->as.vector->length;
+  KObj *res = create_vec(n);
+  for (size_t j = 0; j < n; j++) {
+    KObj *k = vector_get(key, j);
+    size_t i = dict_find(dict, k);
+    release_object(k);
+    if (i == SIZE_MAX) {
+      KObj *zero = create_int(0);
+      vector_append(res, zero);
+      release_object(zero);
+    } else {
+      vector_append_from(res, vals, i);
+    }
+  }
+  return res;
+}
+
+// d[k]:v in place, appending k when it is new. The caller holds the only
+// reference to dict; keys and values shared with other objects are copied
+// before they are written.
+void dict_set(KObj *dict, KObj *key, KObj *value) {
+  KDict *d = dict->as.dict;
+  if (d->values->ref_count > 1) {
+    KObj *copy = vector_copy(d->values);
+    release_object(d->values);
+    d->values = copy;
+  }
+  size_t i = dict_find(dict, key);
+  if (i != SIZE_MAX) {
+    vector_set(d->values, i, value);
+    return;
+  }
+  if (d->keys->ref_count > 1) {
+    KObj *copy = vector_copy(d->keys);
+    release_object(d->keys);
+    d->keys = copy;
+  }
+  vector_append(d->keys, key);
+  vector_append(d->values, value);
+  if (!d->index)
+    return;
+  KVec *keys = d->keys->as.vector;
+  size_t n = keys->length;
+  if (n * 2 > d->slots) {
+    // rebuilt at twice the size by the next lookup
+    free(d->index);
+    d->index = NULL;
+    d->slots = 0;
+    return;
+  }
+  size_t mask = d->slots - 1;
+  size_t p = (size_t)(hash_key(keys, n - 1) & mask);
+  while (d->index[p])
+    p = (p + 1) & mask;
+  d->index[p] = n;
+}
+
 static KObj *build_enum_row(int64_t *dims, size_t dims_len, size_t idx,
                             int64_t total) {
-  KObj *row = create_vec((size_t)total);
+  KObj *row = create_typed_vec(INT, (size_t)total);
   if (total == 0 || dims[idx] == 0)
     return row;
   int64_t repeat_after = 1;
@@ -1180,25 +2162,16 @@ static KObj *build_enum_row(int64_t *dims, size_t dims_len, size_t idx,
   if (repeat_after == 0)
     return row;
   int64_t repeat_before = total / (repeat_after * dims[idx]);
-  KObj *items = row->as.vector->items;
-  KObj **vals = (KObj **)malloc(sizeof(KObj *) * (size_t)dims[idx]);
-  if (!vals)
-    return row;
-  for (int64_t val = 0; val < dims[idx]; val++) {
-    vals[val] = create_int(val);
-  }
+  int64_t *out = row->as.vector->ints;
   size_t pos = 0;
   for (int64_t b = 0; b < repeat_before; b++) {
     for (int64_t val = 0; val < dims[idx]; val++) {
       for (int64_t a = 0; a < repeat_after; a++) {
-        items[pos++] = *vals[val];
+        out[pos++] = val;
       }
     }
   }
   row->as.vector->length = (size_t)total;
-  for (int64_t val = 0; val < dims[idx]; val++)
-    release_object(vals[val]);
-  free(vals);
   return row;
 }
 
@@ -1209,12 +2182,14 @@ static KObj *enum_vector(KObj *value) {
   int64_t *dims = (int64_t *)malloc(sizeof(int64_t) * dims_len);
   int64_t total = 1;
   for (size_t i = 0; i < dims_len; i++) {
-    KObj *item = &value->as.vector->items[i];
+    KObj *item = vector_get(value, i);
     if (!is_number(item)) {
+      release_object(item);
       free(dims);
       return create_nil();
     }
     int64_t d = as_int(item);
+    release_object(item);
     if (d < 0)
       d = 0;
     dims[i] = d;
@@ -1231,32 +2206,23 @@ static KObj *enum_vector(KObj *value) {
 }
 
 static KObj *enum_positive(int64_t n) {
-  KObj *result = create_vec((size_t)n);
-  for (int64_t i = 0; i < n; i++) {
-    KObj *idx = create_int(i);
-    vector_append(result, idx);
-    release_object(idx);
-  }
-  return result;
+  if (n == 0)
+    return create_typed_vec(INT, 0);
+  KNum from = {.i = 0}, by = {.i = 1};
+  return create_range(INT, from, by, (size_t)n);
 }
 
 static KObj *enum_negative(int64_t m) {
   KObj *result = create_vec((size_t)m);
-  KObj *zero = create_int(0);
-  KObj *one = create_int(1);
   for (int64_t r = 0; r < m; r++) {
-    KObj *row = create_vec((size_t)m);
-    KObj *items = row->as.vector->items;
-    for (int64_t c = 0; c < m; c++) {
-      KObj *elem = (r == c) ? one : zero;
-      items[c] = *elem;
-    }
+    KObj *row = create_typed_vec(INT, (size_t)m);
+    int64_t *out = row->as.vector->ints;
+    for (int64_t c = 0; c < m; c++)
+      out[c] = r == c;
     row->as.vector->length = (size_t)m;
     vector_append(result, row);
     release_object(row);
   }
-  release_object(zero);
-  release_object(one);
   return result;
 }
 
@@ -1282,6 +2248,8 @@ KObj *k_count(KObj *value) {
   return create_int(1);
 }
 
+static KObj *take_n(int64_t n, KObj *src);
+
 KObj *k_key(KObj *left, KObj *right) {
   if (left->type != VECTOR) {
     if (left->type == DICT || left->type == VERB || left->type == ADVERB ||
@@ -1300,8 +2268,8 @@ KObj *k_key(KObj *left, KObj *right) {
   }
 
   size_t n = left->as.vector->length;
-  for (size_t i = 0; i < n; i++) {
-    KObj *lk = &left->as.vector->items[i];
+  for (size_t i = 0; i < n && left->as.vector->elem == NIL; i++) {
+    KObj *lk = left->as.vector->items[i];
     if (lk->type == VECTOR || lk->type == DICT || lk->type == VERB ||
         lk->type == ADVERB || lk->type == LAMBDA) {
       printf("^domain\n");
@@ -1316,11 +2284,16 @@ KObj *k_key(KObj *left, KObj *right) {
     }
     if (m == 1) {
       // Broadcast single value to all keys
-      KObj *vals = create_vec(n);
-      KObj *single = &right->as.vector->items[0];
-      for (size_t i = 0; i < n; i++) {
-        vector_append(vals, single);
+      KObj *item = vector_get(right, 0);
+      KObj *vals;
+      if (item->type == VECTOR || item->type == DICT) {
+        vals = create_vec(n);
+        for (size_t i = 0; i < n; i++)
+          vector_append(vals, item);
+      } else {
+        vals = take_n((int64_t)n, item);
       }
+      release_object(item);
       KObj *dict = create_dict(left, vals);
       release_object(vals);
       return dict;
@@ -1334,10 +2307,7 @@ KObj *k_key(KObj *left, KObj *right) {
     printf("^domain\n");
     return create_nil();
   }
-  KObj *vals = create_vec(n);
-  for (size_t i = 0; i < n; i++) {
-    vector_append(vals, right);
-  }
+  KObj *vals = take_n((int64_t)n, right);
   KObj *dict = create_dict(left, vals);
   release_object(vals);
   return dict;
@@ -1351,11 +2321,11 @@ static KObj *take_n(int64_t n, KObj *src) {
     size_t len = src->as.vector->length;
     if (len == 0)
       return create_vec(0);
+    if ((size_t)n <= len)
+      return vector_view(src, 0, (size_t)n);
     KObj *res = create_vec((size_t)n);
-    for (int64_t i = 0; i < n; i++) {
-      KObj *item = &src->as.vector->items[i % len];
-      vector_append(res, item);
-    }
+    for (int64_t i = 0; i < n; i++)
+      vector_append_from(res, src, (size_t)i % len);
     return res;
   }
   if (src->type == DICT) {
@@ -1373,16 +2343,18 @@ static KObj *take_n(int64_t n, KObj *src) {
     KObj *k = create_vec((size_t)n);
     KObj *v = create_vec((size_t)n);
     for (int64_t i = 0; i < n; i++) {
-      KObj *key = &keys->as.vector->items[i % len];
-      KObj *val = &vals->as.vector->items[i % len];
-      vector_append(k, key);
-      vector_append(v, val);
+      vector_append_from(k, keys, (size_t)i % len);
+      vector_append_from(v, vals, (size_t)i % len);
     }
     KObj *d = create_dict(k, v);
     release_object(k);
     release_object(v);
     return d;
   }
+  if (src->type == INT || src->type == FLOAT) {
+    KNum by = {.i = 0};
+    return create_range(src->type, num_of(src), by, (size_t)n);
+  }
   KObj *res = create_vec((size_t)n);
   for (int64_t i = 0; i < n; i++) {
     vector_append(res, src);
@@ -1400,10 +2372,8 @@ static KObj *build_shape(FlatIter *it, int64_t *dims, size_t dim_idx,
   int64_t n = dims[dim_idx];
   KObj *res = create_vec((size_t)n);
   if (dim_idx == dims_len - 1) {
-    for (int64_t i = 0; i < n; i++) {
-      KObj *item = &it->flat->as.vector->items[it->index++];
-      vector_append(res, item);
-    }
+    for (int64_t i = 0; i < n; i++)
+      vector_append_from(res, it->flat, (size_t)it->index++);
   } else {
     for (int64_t i = 0; i < n; i++) {
       KObj *child = build_shape(it, dims, dim_idx + 1, dims_len);
@@ -1430,13 +2400,15 @@ KObj *k_take(KObj *left, KObj *right) {
   int64_t *dims = (int64_t *)malloc(sizeof(int64_t) * dims_len);
   int64_t total = 1;
   for (size_t i = 0; i < dims_len; i++) {
-    KObj *d = &left->as.vector->items[i];
+    KObj *d = vector_get(left, i);
     if (d->type != INT) {
+      release_object(d);
       free(dims);
       printf("^type\n");
       return create_nil();
     }
     int64_t v = d->as.int_value;
+    release_object(d);
     if (v < 0)
       v = 0;
     dims[i] = v;
@@ -1459,10 +2431,8 @@ KObj *k_take(KObj *left, KObj *right) {
     return create_vec(0);
   }
   KObj *flat = create_vec((size_t)total);
-  for (int64_t i = 0; i < total; i++) {
-    KObj *item = &src_vec->as.vector->items[i % src_len];
-    vector_append(flat, item);
-  }
+  for (int64_t i = 0; i < total; i++)
+    vector_append_from(flat, src_vec, (size_t)i % src_len);
   if (created)
     release_object(src_vec);
   FlatIter it = {flat, 0};
@@ -1485,10 +2455,11 @@ static KObj *drop_int(int64_t n, KObj *src) {
     }
     if (end < start)
       end = start;
-    KObj *res = create_vec((size_t)(end - start));
-    for (int64_t i = start; i < end; i++) {
-      vector_append(res, &src->as.vector->items[i]);
-    }
+    if (end > start)
+      return vector_view(src, (size_t)start, (size_t)(end - start));
+    KObj *res = create_vec(0);
+    for (int64_t i = start; i < end; i++)
+      vector_append_from(res, src, (size_t)i);
     return res;
   }
   if (src->type == DICT) {
@@ -1506,7 +2477,28 @@ static KObj *drop_int(int64_t n, KObj *src) {
   return res;
 }
 
+// "abc"_s for flat strings: one pass with a byte membership table.
+static KObj *drop_chars(KObj *lst, KObj *src) {
+  bool drop[256] = {false};
+  KVec *l = lst->as.vector;
+  for (size_t j = 0; j < l->length; j++)
+    drop[(unsigned char)l->chars[j]] = true;
+  KVec *s = src->as.vector;
+  KObj *res = create_typed_vec(CHAR, s->length);
+  char *out = res->as.vector->chars;
+  size_t n = 0;
+  for (size_t i = 0; i < s->length; i++) {
+    if (!drop[(unsigned char)s->chars[i]])
+      out[n++] = s->chars[i];
+  }
+  res->as.vector->length = n;
+  return res;
+}
+
 static KObj *drop_list(KObj *lst, KObj *src) {
+  if (src->type == VECTOR && src->as.vector->elem == CHAR &&
+      lst->as.vector->elem == CHAR && src->as.vector->length > 0)
+    return drop_chars(lst, src);
   KObj *vec = NULL;
   int created = 0;
   if (src->type == VECTOR) {
@@ -1518,16 +2510,19 @@ static KObj *drop_list(KObj *lst, KObj *src) {
   }
   KObj *res = create_vec(vec->as.vector->length);
   for (size_t i = 0; i < vec->as.vector->length; i++) {
-    KObj *item = &vec->as.vector->items[i];
+    KObj *item = vector_get(vec, i);
     bool remove = false;
     for (size_t j = 0; j < lst->as.vector->length && !remove; j++) {
-      if (obj_match(&lst->as.vector->items[j], item)) {
+      KObj *drop = vector_get(lst, j);
+      if (obj_match(drop, item)) {
         remove = true;
       }
+      release_object(drop);
     }
     if (!remove) {
       vector_append(res, item);
     }
+    release_object(item);
   }
   if (created)
     release_object(vec);
@@ -1546,9 +2541,10 @@ static KObj *drop_fn(KObj *fn, KObj *src) {
   }
   KObj *res = create_vec(vec->as.vector->length);
   for (size_t i = 0; i < vec->as.vector->length; i++) {
-    KObj *item = &vec->as.vector->items[i];
+    KObj *item = vector_get(vec, i);
     KObj *r = call_unary(fn, item);
     if (r->type == NIL) {
+      release_object(item);
       if (created)
         release_object(vec);
       release_object(res);
@@ -1576,6 +2572,7 @@ static KObj *drop_fn(KObj *fn, KObj *src) {
     if (!drop) {
       vector_append(res, item);
     }
+    release_object(item);
   }
   if (created)
     release_object(vec);
@@ -1603,40 +2600,55 @@ KObj *k_concat(KObj *left, KObj *right) {
     size_t llen = left->as.vector->length;
     size_t rlen = right->as.vector->length;
     size_t len = llen + rlen;
-    KObj *res = create_vec(len);
-    KObj *out = res->as.vector->items;
-    for (size_t i = 0; i < llen; i++) {
-      out[i] = left->as.vector->items[i];
-      out[i].ref_count = 1;
-    }
-    for (size_t i = 0; i < rlen; i++) {
-      out[llen + i] = right->as.vector->items[i];
-      out[llen + i].ref_count = 1;
-    }
-    res->as.vector->length = len;
+    KObj *res = create_typed_vec(CHAR, len);
+    vector_append_range(res, left, 0, llen);
+    vector_append_range(res, right, 0, rlen);
     return res;
   }
   size_t left_len = left_is_vec ? left->as.vector->length : 1;
   size_t right_len = right_is_vec ? right->as.vector->length : 1;
   KObj *res = create_vec(left_len + right_len);
   if (left_is_vec) {
-    for (size_t i = 0; i < left->as.vector->length; i++) {
-      vector_append(res, &left->as.vector->items[i]);
-    }
+    vector_append_range(res, left, 0, left->as.vector->length);
   } else {
     vector_append(res, left);
   }
   if (right_is_vec) {
-    for (size_t i = 0; i < right->as.vector->length; i++) {
-      vector_append(res, &right->as.vector->items[i]);
-    }
+    vector_append_range(res, right, 0, right->as.vector->length);
   } else {
     vector_append(res, right);
   }
   return res;
 }
 
+// Whether f' can apply func once to whole args instead of item by item:
+// func is an atomic verb form or lambda, and args are numbers and flat
+// numeric vectors of one non-zero length, which it maps the same way.
+static bool each_whole(KObj *func, KObj **args, size_t argn) {
+  size_t len = 0;
+  for (size_t i = 0; i < argn; i++) {
+    KObj *a = args[i];
+    if (a->type == INT || a->type == FLOAT)
+      continue;
+    if (a->type != VECTOR ||
+        (a->as.vector->elem != INT && a->as.vector->elem != FLOAT) ||
+        (len && a->as.vector->length != len))
+      return false;
+    len = a->as.vector->length;
+  }
+  if (len == 0)
+    return false;
+  if (func->type == VERB) {
+    uint8_t form = argn == 1 ? ATOMIC_UNARY : argn == 2 ? ATOMIC_BINARY : 0;
+    return get_op_desc(func->as.verb.op.type)->atomic & form;
+  }
+  return func->type == LAMBDA && atomic_lambda(func, args, argn);
+}
+
 KObj *k_each(KObj *func, KObj *left, KObj *right) {
+  KObj *args[2] = {left, right};
+  if (each_whole(func, args, right ? 2 : 1))
+    return call_n(func, args, right ? 2 : 1);
   bool left_is_vec = left->type == VECTOR;
   bool right_is_vec = right ? right->type == VECTOR : false;
   if (!right) {
@@ -1646,10 +2658,11 @@ KObj *k_each(KObj *func, KObj *left, KObj *right) {
     }
     KObj *res = create_vec(left->as.vector->length);
     for (size_t i = 0; i < left->as.vector->length; i++) {
-      KObj *item = &left->as.vector->items[i];
+      KObj *item = vector_get(left, i);
       KObj *val = NULL;
       if (func->type == VERB) {
         if (!func->as.verb.unary) {
+          release_object(item);
           release_object(res);
           printf("^rank\n");
           return create_nil();
@@ -1658,10 +2671,12 @@ KObj *k_each(KObj *func, KObj *left, KObj *right) {
       } else if (func->type == LAMBDA || func->type == PROJ) {
         val = call_unary(func, item);
       } else {
+        release_object(item);
         release_object(res);
         printf("^type\n");
         return create_nil();
       }
+      release_object(item);
       if (val->type == NIL) {
         release_object(res);
         return val;
@@ -1683,14 +2698,19 @@ KObj *k_each(KObj *func, KObj *left, KObj *right) {
   }
   KObj *res = create_vec(len);
   for (size_t i = 0; i < len; i++) {
-    KObj *l = left_is_vec ? &left->as.vector->items[i] : left;
-    KObj *r = right_is_vec ? &right->as.vector->items[i] : right;
+    KObj *l = left_is_vec ? vector_get(left, i) : left;
+    KObj *r = right_is_vec ? vector_get(right, i) : right;
     KObj *val = NULL;
     if (func->type == VERB && func->as.verb.binary) {
       val = func->as.verb.binary(l, r);
     } else if (func->type == LAMBDA || func->type == PROJ) {
       val = call_binary(func, l, r);
-    } else {
+    }
+    if (left_is_vec)
+      release_object(l);
+    if (right_is_vec)
+      release_object(r);
+    if (!val) {
       release_object(res);
       printf("^type\n");
       return create_nil();
@@ -1713,6 +2733,8 @@ KObj *k_each_n(KObj *func, KObj **args, size_t argn) {
   if (argn == 1) {
     return k_each(func, args[0], NULL);
   }
+  if (each_whole(func, args, argn))
+    return call_n(func, args, argn);
   size_t len = 0;
   int have_vec = 0;
   for (size_t i = 0; i < argn; i++) {
@@ -1737,15 +2759,18 @@ KObj *k_each_n(KObj *func, KObj **args, size_t argn) {
       }
     }
   }
+  ArenaMark scratch = arena_mark(&global_arena);
+  KObj **call_args =
+      (KObj **)arena_alloc(&global_arena, sizeof(KObj *) * argn);
   KObj *res = create_vec(len);
   for (size_t i = 0; i < len; i++) {
-    KObj **call_args = (KObj **)malloc(sizeof(KObj *) * argn);
     for (size_t j = 0; j < argn; j++) {
       if (args[j]->type == VECTOR) {
         size_t l = args[j]->as.vector->length;
-        call_args[j] = &args[j]->as.vector->items[(l == 1) ? 0 : i];
+        call_args[j] = vector_get(args[j], (l == 1) ? 0 : i);
       } else {
         call_args[j] = args[j];
+        retain_object(args[j]);
       }
     }
     KObj *val = NULL;
@@ -1754,36 +2779,178 @@ KObj *k_each_n(KObj *func, KObj **args, size_t argn) {
         val = func->as.verb.unary(call_args[0]);
       } else if (argn == 2 && func->as.verb.binary) {
         val = func->as.verb.binary(call_args[0], call_args[1]);
-      } else {
-        free(call_args);
-        release_object(res);
-        printf("^rank\n");
-        return create_nil();
       }
     } else if (func->type == LAMBDA || func->type == PROJ) {
       val = call_n(func, call_args, argn);
-    } else {
-      free(call_args);
+    }
+    for (size_t j = 0; j < argn; j++)
+      release_object(call_args[j]);
+    if (!val) {
       release_object(res);
-      printf("^type\n");
+      arena_release(&global_arena, scratch);
+      printf(func->type == VERB ? "^rank\n" : "^type\n");
       return create_nil();
     }
-    free(call_args);
     if (val->type == NIL) {
       release_object(res);
+      arena_release(&global_arena, scratch);
       return val;
     }
     vector_append(res, val);
     release_object(val);
   }
+  arena_release(&global_arena, scratch);
   return res;
 }
 
+// +/ over a virtual vector. Ints use the closed form, which wraps exactly
+// like the running sum; floats are added in order as k_over would.
+static KObj *virtual_sum(KVec *v) {
+  uint64_t n = v->length;
+  if (v->elem == INT) {
+    uint64_t pairs = n % 2 == 0 ? (n / 2) * (n - 1) : n * ((n - 1) / 2);
+    return create_int((int64_t)(n * (uint64_t)v->from.i +
+                                pairs * (uint64_t)v->by.i));
+  }
+  double sum = v->from.f;
+  for (uint64_t i = 1; i < n; i++)
+    sum += v->by.f == 0 ? v->from.f : v->from.f + (double)i * v->by.f;
+  return create_float(sum);
+}
+
+// Items reduced between checks for an accumulator no later item can move.
+#define OVER_BLOCK 1024
+
+// Folds n ints into acc, wrapping like the boxed ops.
+static int64_t int_over(FlatOp f, int64_t acc, const int64_t *x, size_t n) {
+  uint64_t r = (uint64_t)acc, sum = 0;
+  switch (f) {
+  case FLAT_ADD:
+  case FLAT_SUB:
+    // (a-b)-c is a-(b+c) in wrapping arithmetic
+    for (size_t i = 0; i < n; i++)
+      sum += (uint64_t)x[i];
+    return (int64_t)(f == FLAT_ADD ? r + sum : r - sum);
+  case FLAT_MUL:
+    for (size_t i = 0; i < n; i++)
+      r *= (uint64_t)x[i];
+    return (int64_t)r;
+  case FLAT_MAX:
+    for (size_t i = 0; i < n; i++)
+      acc = acc > x[i] ? acc : x[i];
+    return acc;
+  case FLAT_MIN:
+    for (size_t i = 0; i < n; i++)
+      acc = acc < x[i] ? acc : x[i];
+    return acc;
+  default:
+    return acc;
+  }
+}
+
+// Whether acc is final whatever items follow: 0 for *, the extremes for
+// | and &, and 1 or 0 when the items are booleans.
+static bool int_over_done(FlatOp f, int64_t acc, bool bools) {
+  switch (f) {
+  case FLAT_MUL:
+    return acc == 0;
+  case FLAT_MAX:
+    return acc == INT64_MAX || (bools && acc >= 1);
+  case FLAT_MIN:
+    return acc == INT64_MIN || (bools && acc <= 0);
+  default:
+    return false;
+  }
+}
+
+// f/ over a non-empty INT/FLOAT vector for an arithmetic verb, seeded by
+// an optional INT/FLOAT atom, without boxing the items. Floats are folded
+// strictly in order so the result matches the boxed ops bit for bit.
+static KObj *flat_over(FlatOp f, KObj *list, KObj *init) {
+  KVec *v = list->as.vector;
+  size_t n = v->length, i = 0;
+  if (v->elem == INT && (!init || init->type == INT)) {
+    const int64_t *x = v->ints;
+    int64_t acc = init ? init->as.int_value : x[i++];
+    bool bools = v->attr & ATTR_BOOL;
+    while (i < n && !int_over_done(f, acc, bools)) {
+      size_t m = n - i < OVER_BLOCK ? n - i : OVER_BLOCK;
+      acc = int_over(f, acc, x + i, m);
+      i += m;
+    }
+    return create_int(acc);
+  }
+  FlatArg a = {v->elem, v->items, 1};
+  double acc = init ? as_double(init) : flat_f(&a, i++);
+  switch (f) {
+  case FLAT_ADD:
+    for (; i < n; i++)
+      acc += flat_f(&a, i);
+    break;
+  case FLAT_SUB:
+    for (; i < n; i++)
+      acc -= flat_f(&a, i);
+    break;
+  case FLAT_MUL:
+    for (; i < n; i++)
+      acc *= flat_f(&a, i);
+    break;
+  case FLAT_MAX:
+    for (; i < n; i++) {
+      double y = flat_f(&a, i);
+      acc = acc > y ? acc : y;
+    }
+    break;
+  case FLAT_MIN:
+    for (; i < n; i++) {
+      double y = flat_f(&a, i);
+      acc = acc < y ? acc : y;
+    }
+    break;
+  default:
+    break;
+  }
+  return create_float(acc);
+}
+
+// The arithmetic verb flat_over can fold for func, or FLAT_NONE.
+static FlatOp over_op(KObj *func) {
+  if (func->type != VERB)
+    return FLAT_NONE;
+  KObj *(*fn)(KObj *, KObj *) = func->as.verb.binary;
+  if (fn == k_add)
+    return FLAT_ADD;
+  if (fn == k_sub)
+    return FLAT_SUB;
+  if (fn == k_mul)
+    return FLAT_MUL;
+  if (fn == k_max)
+    return FLAT_MAX;
+  if (fn == k_min)
+    return FLAT_MIN;
+  return FLAT_NONE;
+}
+
 KObj *k_over(KObj *func, KObj *list, KObj *init) {
   if (list->type != VECTOR) {
     printf("^type\n");
     return create_nil();
   }
+  if (!init && is_virtual(list) && func->type == VERB &&
+      func->as.verb.binary == k_add)
+    return virtual_sum(list->as.vector);
+  KVec *v = list->as.vector;
+  if (!init && v->length > 0 && v->attr & ATTR_SORTED &&
+      (v->elem == INT || v->elem == FLOAT) && func->type == VERB &&
+      (func->as.verb.binary == k_min || func->as.verb.binary == k_max))
+    return vector_get(list, func->as.verb.binary == k_min ? 0 : v->length - 1);
+  FlatOp f = over_op(func);
+  if (f != FLAT_NONE && v->length > 0 &&
+      (v->elem == INT || v->elem == FLOAT) &&
+      (!init || init->type == INT || init->type == FLOAT)) {
+    vector_force(list);
+    return flat_over(f, list, init);
+  }
   size_t start = 0;
   KObj *result = NULL;
   if (init) {
@@ -1793,18 +2960,19 @@ KObj *k_over(KObj *func, KObj *list, KObj *init) {
     if (list->as.vector->length == 0) {
       return create_nil();
     }
-    result = &list->as.vector->items[0];
-    retain_object(result);
+    result = vector_get(list, 0);
     start = 1;
   }
   for (size_t i = start; i < list->as.vector->length; i++) {
-    KObj *item = &list->as.vector->items[i];
+    KObj *item = vector_get(list, i);
     KObj *next = NULL;
     if (func->type == VERB && func->as.verb.binary) {
       next = func->as.verb.binary(result, item);
     } else if (func->type == LAMBDA || func->type == PROJ) {
       next = call_binary(func, result, item);
-    } else {
+    }
+    release_object(item);
+    if (!next) {
       printf("^type\n");
       release_object(result);
       return create_nil();
@@ -1822,12 +2990,12 @@ KObj *k_join(KObj *sep, KObj *list) {
     printf("^type\n");
     return create_nil();
   }
-  KObj *sep_char = NULL;
+  char sep_char;
   if (sep->type == CHAR) {
-    sep_char = sep;
+    sep_char = sep->as.char_value;
   } else if (sep->type == VECTOR && sep->as.vector->length == 1 &&
-             is_char_vector(sep)) {
-    sep_char = &sep->as.vector->items[0];
+             sep->as.vector->elem == CHAR) {
+    sep_char = sep->as.vector->chars[0];
   } else {
     printf("^type\n");
     return create_nil();
@@ -1835,35 +3003,29 @@ KObj *k_join(KObj *sep, KObj *list) {
   size_t total_len = 0;
   size_t list_len = list->as.vector->length;
   for (size_t i = 0; i < list_len; i++) {
-    KObj *item = &list->as.vector->items[i];
-    if (!is_char_vector(item)) {
+    KObj *item = vector_get(list, i);
+    bool ok = is_char_vector(item);
+    if (ok)
+      total_len += item->as.vector->length;
+    release_object(item);
+    if (!ok) {
       printf("^type (join requires list of strings)\n");
       return create_nil();
     }
-    total_len += item->as.vector->length;
   }
   if (list_len > 1)
     total_len += (list_len - 1);
 
-  KObj *res = create_vec(total_len);
-  KObj *out = res->as.vector->items;
-  size_t pos = 0;
+  KObj *res = create_typed_vec(CHAR, total_len);
+  KObj *sep_obj = create_char(sep_char);
   for (size_t i = 0; i < list_len; i++) {
-    KObj *item = &list->as.vector->items[i];
-    for (size_t j = 0; j < item->as.vector->length; j++) {
-      // Copy char inline
-      out[pos] = item->as.vector->items[j];
-      out[pos].ref_count = 1;
-      pos++;
-    }
-    if (i < list_len - 1) {
-      out[pos].type = CHAR;
-      out[pos].ref_count = 1;
-      out[pos].as.char_value = sep_char->as.char_value;
-      pos++;
-    }
+    KObj *item = vector_get(list, i);
+    vector_append_range(res, item, 0, item->as.vector->length);
+    release_object(item);
+    if (i < list_len - 1)
+      vector_append(res, sep_obj);
   }
-  res->as.vector->length = pos;
+  release_object(sep_obj);
   return res;
 }
 
@@ -1875,12 +3037,14 @@ KObj *k_decode(KObj *base, KObj *list) {
   int64_t b = base->as.int_value;
   int64_t result = 0;
   for (size_t i = 0; i < list->as.vector->length; i++) {
-    KObj *item = &list->as.vector->items[i];
+    KObj *item = vector_get(list, i);
     if (!is_number(item)) {
+      release_object(item);
       printf("^type\n");
       return create_nil();
     }
     result = result * b + as_int(item);
+    release_object(item);
   }
   return create_int(result);
 }
@@ -1912,8 +3076,8 @@ KObj *k_encode(KObj *base, KObj *num) {
     tmp /= b;
     count++;
   }
-  KObj *res = create_vec(count);
-  int64_t *digits = (int64_t *)malloc(sizeof(int64_t) * count);
+  KObj *res = create_typed_vec(INT, count);
+  int64_t *digits = res->as.vector->ints;
   tmp = n;
   for (size_t i = 0; i < count; i++) {
     digits[count - 1 - i] = tmp % b;
@@ -1922,12 +3086,86 @@ KObj *k_encode(KObj *base, KObj *num) {
   if (sign < 0 && count > 0) {
     digits[0] *= -1;
   }
-  for (size_t i = 0; i < count; i++) {
-    KObj *d = create_int(digits[i]);
-    vector_append(res, d);
-    release_object(d);
+  res->as.vector->length = count;
+  return res;
+}
+
+// f\ counterpart of flat_over: the running values go straight into a
+// flat result, which excludes the seed as the boxed scan does.
+static KObj *flat_scan(FlatOp f, KObj *list, KObj *init) {
+  KVec *v = list->as.vector;
+  size_t n = v->length, i = 0;
+  if (v->elem == INT && (!init || init->type == INT)) {
+    const int64_t *x = v->ints;
+    KObj *res = create_typed_vec(INT, n);
+    int64_t *out = res->as.vector->ints;
+    uint64_t acc = init ? (uint64_t)init->as.int_value : (uint64_t)x[i++];
+    if (!init)
+      out[0] = (int64_t)acc;
+    switch (f) {
+    case FLAT_ADD:
+      for (; i < n; i++)
+        out[i] = (int64_t)(acc += (uint64_t)x[i]);
+      break;
+    case FLAT_SUB:
+      for (; i < n; i++)
+        out[i] = (int64_t)(acc -= (uint64_t)x[i]);
+      break;
+    case FLAT_MUL:
+      for (; i < n; i++)
+        out[i] = (int64_t)(acc *= (uint64_t)x[i]);
+      break;
+    case FLAT_MAX:
+      for (int64_t m = (int64_t)acc; i < n; i++)
+        out[i] = m = m > x[i] ? m : x[i];
+      // a running maximum never decreases
+      res->as.vector->attr = ATTR_SORTED | ATTR_GROUPED;
+      break;
+    case FLAT_MIN:
+      for (int64_t m = (int64_t)acc; i < n; i++)
+        out[i] = m = m < x[i] ? m : x[i];
+      break;
+    default:
+      break;
+    }
+    res->as.vector->length = n;
+    return res;
+  }
+  FlatArg a = {v->elem, v->items, 1};
+  KObj *res = create_typed_vec(FLOAT, n);
+  double *out = res->as.vector->floats;
+  double acc = init ? as_double(init) : flat_f(&a, i++);
+  if (!init)
+    out[0] = acc;
+  switch (f) {
+  case FLAT_ADD:
+    for (; i < n; i++)
+      out[i] = acc += flat_f(&a, i);
+    break;
+  case FLAT_SUB:
+    for (; i < n; i++)
+      out[i] = acc -= flat_f(&a, i);
+    break;
+  case FLAT_MUL:
+    for (; i < n; i++)
+      out[i] = acc *= flat_f(&a, i);
+    break;
+  case FLAT_MAX:
+    for (; i < n; i++) {
+      double y = flat_f(&a, i);
+      out[i] = acc = acc > y ? acc : y;
+    }
+    break;
+  case FLAT_MIN:
+    for (; i < n; i++) {
+      double y = flat_f(&a, i);
+      out[i] = acc = acc < y ? acc : y;
+    }
+    break;
+  default:
+    break;
   }
-  free(digits);
+  res->as.vector->length = n;
   return res;
 }
 
@@ -1936,6 +3174,14 @@ KObj *k_scan(KObj *func, KObj *list, KObj *init) {
     printf("^type\n");
     return create_nil();
   }
+  KVec *v = list->as.vector;
+  FlatOp f = over_op(func);
+  if (f != FLAT_NONE && v->length > 0 &&
+      (v->elem == INT || v->elem == FLOAT) &&
+      (!init || init->type == INT || init->type == FLOAT)) {
+    vector_force(list);
+    return flat_scan(f, list, init);
+  }
   KObj *res = create_vec(list->as.vector->length);
   size_t start = 0;
   KObj *acc = NULL;
@@ -1945,19 +3191,20 @@ KObj *k_scan(KObj *func, KObj *list, KObj *init) {
   } else {
     if (list->as.vector->length == 0)
       return res;
-    acc = &list->as.vector->items[0];
-    retain_object(acc);
+    acc = vector_get(list, 0);
     vector_append(res, acc);
     start = 1;
   }
   for (size_t i = start; i < list->as.vector->length; i++) {
-    KObj *item = &list->as.vector->items[i];
+    KObj *item = vector_get(list, i);
     KObj *next = NULL;
     if (func->type == VERB && func->as.verb.binary) {
       next = func->as.verb.binary(acc, item);
     } else if (func->type == LAMBDA || func->type == PROJ) {
       next = call_binary(func, acc, item);
-    } else {
+    }
+    release_object(item);
+    if (!next) {
       printf("^type\n");
       release_object(acc);
       release_object(res);
@@ -1976,14 +3223,14 @@ KObj *k_scan(KObj *func, KObj *list, KObj *init) {
 
 KObj *k_split(KObj *sep, KObj *str) {
   size_t sep_len = 0;
-  KObj *sep_items = NULL;
+  const char *sep_chars = NULL;
   if (sep->type == CHAR) {
     sep_len = 1;
-    sep_items = sep;
-  } else if (sep->type == VECTOR && is_char_vector(sep) &&
+    sep_chars = &sep->as.char_value;
+  } else if (sep->type == VECTOR && sep->as.vector->elem == CHAR &&
              sep->as.vector->length > 0) {
     sep_len = sep->as.vector->length;
-    sep_items = sep->as.vector->items;
+    sep_chars = sep->as.vector->chars;
   } else {
     printf("^type\n");
     return create_nil();
@@ -1992,32 +3239,37 @@ KObj *k_split(KObj *sep, KObj *str) {
     printf("^type\n");
     return create_nil();
   }
+  size_t len = str->as.vector->length;
+  if (str->as.vector->elem != CHAR) {
+    KObj *flat = create_typed_vec(CHAR, len);
+    for (size_t i = 0; i < len; i++)
+      vector_append_from(flat, str, i);
+    KObj *res = len > 0 ? k_split(sep, flat) : NULL;
+    release_object(flat);
+    if (res)
+      return res;
+  }
+  const char *chars = len > 0 ? str->as.vector->chars : "";
   KObj *res = create_vec(4);
-  KObj *part = create_vec(str->as.vector->length);
-  size_t i = 0;
-  while (i < str->as.vector->length) {
-    bool match = false;
-    if (i + sep_len <= str->as.vector->length) {
-      match = true;
-      for (size_t j = 0; j < sep_len; j++) {
-        if (str->as.vector->items[i + j].as.char_value !=
-            sep_items[j].as.char_value) {
-          match = false;
-          break;
-        }
-      }
-    }
-    if (match) {
-      vector_append(res, part);
-      release_object(part);
-      part = create_vec(str->as.vector->length - i - sep_len);
-      i += sep_len;
-    } else {
-      vector_append(part, &str->as.vector->items[i]);
-      i++;
-    }
+  // parts are views of str; memchr finds each candidate separator
+  size_t start = 0, i = 0;
+  for (;;) {
+    const char *hit = NULL;
+    while (i + sep_len <= len) {
+      hit = memchr(chars + i, sep_chars[0], len - sep_len + 1 - i);
+      if (!hit || memcmp(hit, sep_chars, sep_len) == 0)
+        break;
+      i = (size_t)(hit - chars) + 1;
+      hit = NULL;
+    }
+    size_t end = hit ? (size_t)(hit - chars) : len;
+    KObj *part = end > start ? vector_view(str, start, end - start)
+                             : create_typed_vec(CHAR, 0);
+    vector_append(res, part);
+    release_object(part);
+    if (!hit)
+      break;
+    start = i = end + sep_len;
   }
-  vector_append(res, part);
-  release_object(part);
   return res;
 }
@@ -1,7 +1,9 @@
 #ifndef BUILTINS_H_
 #define BUILTINS_H_
 
+#include "ast.h"
 #include "def.h"
+#include <stdbool.h>
 
 KObj *k_add(KObj *left, KObj *right);
 KObj *k_sub(KObj *left, KObj *right);
@@ -49,5 +51,20 @@ KObj *k_decode(KObj *base, KObj *list);
 KObj *k_scan(KObj *func, KObj *list, KObj *init);
 KObj *k_split(KObj *sep, KObj *str);
 KObj *k_encode(KObj *base, KObj *num);
+KObj *k_binary_owned(BinaryFunc fn, KObj *left, KObj *right);
+KObj *k_unary_owned(UnaryFunc fn, KObj *value);
+// Atomic verbs over same-length lists of numbers can run as one loop, a
+// block of items at a time, building no whole intermediate lists.
+#define FUSED_MAX 32 // nodes in one fused tree
+// Whether k_fused runs the verb of n, an AST_UNARY or AST_BINARY node.
+bool fused_verb(ASTNode *n);
+// The value of n, a tree of such verbs over literals and variables, vars
+// holding the variables' values in the order they appear. NULL when the
+// values do not suit one loop: no list among them, lists of other lengths
+// or types, or an item such as x%0 that only the verbs' own path gives.
+KObj *k_fused(ASTNode *n, KObj **vars);
+size_t dict_find(KObj *dict, KObj *key);
+KObj *dict_get(KObj *dict, KObj *key);
+void dict_set(KObj *dict, KObj *key, KObj *value);
 
 #endif
@@ -0,0 +1,716 @@
+#include "compile.h"
+#include "arena.h"
+#include "ast.h"
+#include "builtins.h"
+#include "def.h"
+#include "jit.h"
+#include "ops.h"
+#include "opt.h"
+#include "sym.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Code, pool and guards grow in malloc'd buffers while a chunk is being
+// compiled and are copied into the target arena once they are complete.
+typedef struct {
+  uint32_t *code;
+  size_t len, cap;
+  const void **pool;
+  size_t pool_len, pool_cap;
+  Guard *guards;
+  size_t guard_len, guard_cap;
+  CallSite *sites;
+  size_t site_len, site_cap;
+  size_t depth, max_depth;
+  const char **names; // locals by slot
+  size_t name_len, name_cap;
+  bool tail; // the node being compiled gives the value the lambda returns
+  bool plain; // the fallback of an OP_FUSED, not to be fused again
+} Compiler;
+
+static void *grow(void *buf, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap)
+    return buf;
+  size_t n = *cap ? *cap * 2 : 64;
+  while (n < need)
+    n *= 2;
+  *cap = n;
+  return realloc(buf, n * size);
+}
+
+static void emit(Compiler *c, uint32_t word) {
+  c->code = (uint32_t *)grow(c->code, &c->cap, c->len + 1, sizeof(uint32_t));
+  c->code[c->len++] = word;
+}
+
+static uint32_t pool(Compiler *c, const void *p) {
+  c->pool = (const void **)grow((void *)c->pool, &c->pool_cap,
+                                c->pool_len + 1, sizeof(void *));
+  c->pool[c->pool_len] = p;
+  return (uint32_t)c->pool_len++;
+}
+
+// The slot of name among the locals, or VAR_LOCAL when it has none; the
+// last of repeated parameters wins, as it did when they were bound by name.
+// Names are interned, so they compare by pointer.
+static uint32_t local_slot(Compiler *c, const char *name) {
+  for (size_t i = c->name_len; i-- > 0;) {
+    if (c->names[i] == name)
+      return (uint32_t)i;
+  }
+  return VAR_LOCAL;
+}
+
+static void add_local(Compiler *c, const char *name) {
+  c->names = (const char **)grow((void *)c->names, &c->name_cap,
+                                 c->name_len + 1, sizeof(char *));
+  c->names[c->name_len++] = name;
+}
+
+static uint32_t var(Compiler *c, const char *name) {
+  uint32_t slot = local_slot(c, name);
+  return slot == VAR_LOCAL ? pool(c, name) : VAR_LOCAL | slot;
+}
+
+// A new call site, whose callee is the variable of that name or, when it is
+// NULL, some other expression. Only a global callee is cached.
+static uint32_t site(Compiler *c, const char *callee, bool tail) {
+  c->sites = (CallSite *)grow(c->sites, &c->site_cap, c->site_len + 1,
+                              sizeof(CallSite));
+  CallSite *s = &c->sites[c->site_len];
+  memset(s, 0, sizeof(CallSite));
+  s->name = callee && local_slot(c, callee) == VAR_LOCAL ? callee : NULL;
+  s->tail = tail;
+  return (uint32_t)c->site_len++;
+}
+
+// Track the stack effect of the code emitted so far.
+static void push(Compiler *c, size_t n) {
+  c->depth += n;
+  if (c->depth > c->max_depth)
+    c->max_depth = c->depth;
+}
+
+static void pop(Compiler *c, size_t n) { c->depth -= n; }
+
+// Emit a jump with its target left open; patch() points it here.
+static size_t jump(Compiler *c, OpCode op) {
+  emit(c, op);
+  emit(c, 0);
+  return c->len - 1;
+}
+
+static void patch(Compiler *c, size_t at) { c->code[at] = (uint32_t)c->len; }
+
+static void compile_node(Compiler *c, ASTNode *n);
+
+static void compile_guarded(Compiler *c, ASTNode *n) {
+  c->guards = (Guard *)grow(c->guards, &c->guard_cap, c->guard_len + 1,
+                            sizeof(Guard));
+  size_t g = c->guard_len++;
+  c->guards[g].start = (uint32_t)c->len;
+  c->guards[g].depth = (uint32_t)c->depth;
+  compile_node(c, n);
+  c->guards[g].end = (uint32_t)c->len;
+}
+
+// Items in order, leaving the last one's value; nil when there are none.
+static void compile_seq(Compiler *c, ASTNode **items, size_t count) {
+  if (count == 0) {
+    emit(c, OP_NIL);
+    push(c, 1);
+    return;
+  }
+  bool tail = c->tail;
+  c->tail = false;
+  for (size_t i = 0; i + 1 < count; i++) {
+    compile_guarded(c, items[i]);
+    emit(c, OP_POP);
+    pop(c, 1);
+  }
+  c->tail = tail;
+  compile_node(c, items[count - 1]);
+}
+
+static bool is_var(ASTNode *n, const char *name) {
+  return n && n->type == AST_VAR && n->as.var.name == name;
+}
+
+// Values are immutable while shared, so a literal is pushed as it is
+// rather than copied, unless it is a list holding nil, which fails when
+// evaluated.
+static bool shareable(KObj *v) {
+  if (v->type == NIL)
+    return false;
+  if (v->type != VECTOR || v->as.vector->elem != NIL)
+    return true;
+  for (size_t i = 0; i < v->as.vector->length; i++) {
+    if (!shareable(v->as.vector->items[i]))
+      return false;
+  }
+  return true;
+}
+
+static bool is_const(ASTNode *n) {
+  return n && n->type == AST_LITERAL && n->as.literal.value &&
+         shareable(n->as.literal.value);
+}
+
+// name:name op y with y a literal or variable, or name:op name.
+static bool is_self_update(const char *name, ASTNode *expr) {
+  if (expr->type == AST_UNARY)
+    return is_var(expr->as.unary.child, name) &&
+           get_op_desc(expr->as.unary.op.type)->unary;
+  if (expr->type != AST_BINARY || expr->as.binary.op.type == COLON)
+    return false;
+  ASTNode *right = expr->as.binary.right;
+  return is_var(expr->as.binary.left, name) && right &&
+         (right->type == AST_LITERAL || right->type == AST_VAR) &&
+         get_op_desc(expr->as.binary.op.type)->binary;
+}
+
+static void compile_assign(Compiler *c, ASTNode *n) {
+  ASTNode *left = n->as.binary.left;
+  ASTNode *right = n->as.binary.right;
+  if (left->type == AST_VAR) {
+    const char *name = left->as.var.name;
+    if (is_self_update(name, right)) {
+      if (right->type == AST_BINARY) {
+        compile_node(c, right->as.binary.right);
+        pop(c, 1);
+      }
+      emit(c, OP_SELF_UPDATE);
+      emit(c, var(c, name));
+      emit(c, pool(c, n));
+      push(c, 1);
+      return;
+    }
+    compile_node(c, right);
+    emit(c, OP_SET);
+    emit(c, var(c, name));
+    return;
+  }
+  if (left->type == AST_CALL && left->as.call.callee->type == AST_VAR &&
+      left->as.call.arg_count >= 1) {
+    size_t argc = left->as.call.arg_count;
+    emit(c, OP_GET_UNIQUE);
+    emit(c, var(c, left->as.call.callee->as.var.name));
+    emit(c, argc == 1);
+    push(c, 1);
+    if (argc == 1) {
+      compile_node(c, left->as.call.args[0]);
+      compile_node(c, right);
+      emit(c, OP_AMEND);
+      pop(c, 2);
+      return;
+    }
+    for (size_t i = 0; i < argc; i++) {
+      compile_node(c, left->as.call.args[i]);
+      emit(c, OP_CHECK_INT);
+    }
+    emit(c, OP_AMEND_WALK);
+    emit(c, (uint32_t)argc);
+    pop(c, argc - 1);
+    compile_node(c, right);
+    emit(c, OP_AMEND_SET);
+    pop(c, 2);
+    return;
+  }
+  emit(c, OP_ASSIGN_ERROR);
+  push(c, 1);
+}
+
+// Arguments in order, except that an assignment among the arguments of
+// an adverb is evaluated first, so the others can use the name it sets.
+static void compile_args(Compiler *c, ASTNode *n, size_t first) {
+  size_t argn = n->as.call.arg_count;
+  if (first < argn)
+    compile_node(c, n->as.call.args[first]);
+  for (size_t i = 0; i < argn; i++) {
+    if (i != first)
+      compile_node(c, n->as.call.args[i]);
+  }
+  if (first < argn && first > 0) {
+    emit(c, OP_PLACE);
+    emit(c, (uint32_t)first);
+    emit(c, (uint32_t)argn);
+  }
+}
+
+static void compile_call(Compiler *c, ASTNode *n, bool tail) {
+  ASTNode *callee = n->as.call.callee;
+  size_t argn = n->as.call.arg_count;
+  size_t assign = argn;
+  for (size_t i = 0; argn >= 2 && i < argn; i++) {
+    ASTNode *a = n->as.call.args[i];
+    if (a && a->type == AST_BINARY && a->as.binary.op.type == COLON &&
+        a->as.binary.left && a->as.binary.left->type == AST_VAR) {
+      assign = i;
+      break;
+    }
+  }
+  if (callee->type == AST_ADVERB) {
+    compile_node(c, callee->as.adverb.child);
+    compile_args(c, n, assign);
+    emit(c, OP_CALL_ADVERB);
+    emit(c, pool(c, callee));
+    emit(c, (uint32_t)argn);
+    pop(c, argn);
+    return;
+  }
+  const char *name = callee->type == AST_VAR ? callee->as.var.name : NULL;
+  if (name && argn == 1) {
+    ASTNode *arg = n->as.call.args[0];
+    if (arg && arg->type == AST_VAR) {
+      emit(c, OP_GET_GET_CALL);
+      emit(c, var(c, name));
+      emit(c, var(c, arg->as.var.name));
+      emit(c, site(c, name, tail));
+      push(c, 1);
+      return;
+    }
+    if (is_const(arg)) {
+      emit(c, OP_GET_CONST_CALL);
+      emit(c, var(c, name));
+      emit(c, pool(c, arg));
+      emit(c, site(c, name, tail));
+      push(c, 1);
+      return;
+    }
+  }
+  compile_node(c, callee);
+  if (assign < argn) {
+    // only an adverb reorders its arguments, and the callee is known
+    // to be one only once it has been evaluated
+    size_t other = jump(c, OP_UNLESS_ADVERB);
+    compile_args(c, n, assign);
+    size_t done = jump(c, OP_JUMP);
+    pop(c, argn);
+    patch(c, other);
+    compile_args(c, n, argn);
+    patch(c, done);
+  } else {
+    compile_args(c, n, argn);
+  }
+  emit(c, OP_CALL);
+  emit(c, (uint32_t)argn);
+  emit(c, site(c, name, tail));
+  pop(c, argn);
+}
+
+static void compile_binary(Compiler *c, ASTNode *n) {
+  ASTNode *left = n->as.binary.left;
+  ASTNode *right = n->as.binary.right;
+  TokenType op = n->as.binary.op.type;
+  if (op == COLON) {
+    compile_assign(c, n);
+    return;
+  }
+  bool verb = get_op_desc(op)->binary != NULL;
+  bool lvar = left && left->type == AST_VAR;
+  bool rvar = right && right->type == AST_VAR;
+  if (verb && lvar && (rvar || is_const(right))) {
+    emit(c, rvar ? OP_GET_GET_BINARY : OP_GET_CONST_BINARY);
+    emit(c, var(c, left->as.var.name));
+    emit(c, rvar ? var(c, right->as.var.name) : pool(c, right));
+    emit(c, op);
+    push(c, 1);
+    return;
+  }
+  if (verb && is_const(left) && rvar) {
+    emit(c, OP_CONST_GET_BINARY);
+    emit(c, pool(c, left));
+    emit(c, var(c, right->as.var.name));
+    emit(c, op);
+    push(c, 1);
+    return;
+  }
+  compile_node(c, left);
+  compile_node(c, right);
+  if (verb) {
+    emit(c, OP_BINARY);
+    emit(c, op);
+  } else {
+    emit(c, OP_NYI);
+    emit(c, 2);
+  }
+  pop(c, 1);
+}
+
+// Verbs in n when it is a tree of verbs k_fused runs over variables and
+// literals, counting its nodes into nodes; 0 for a leaf, SIZE_MAX when n
+// is not such a tree.
+static size_t fused_verbs(ASTNode *n, size_t *nodes) {
+  if (!n)
+    return SIZE_MAX;
+  ++*nodes;
+  if (n->type == AST_VAR || (n->type == AST_LITERAL && n->as.literal.value))
+    return 0;
+  if ((n->type != AST_UNARY && n->type != AST_BINARY) || !fused_verb(n))
+    return SIZE_MAX;
+  size_t verbs = n->type == AST_UNARY
+                     ? fused_verbs(n->as.unary.child, nodes)
+                     : fused_verbs(n->as.binary.left, nodes);
+  if (n->type == AST_BINARY && verbs != SIZE_MAX) {
+    size_t right = fused_verbs(n->as.binary.right, nodes);
+    verbs = right == SIZE_MAX ? SIZE_MAX : verbs + right;
+  }
+  return verbs == SIZE_MAX ? SIZE_MAX : verbs + 1;
+}
+
+// Emits the var operands of the variables in n, in the order k_fused
+// takes their values.
+static uint32_t fused_vars(Compiler *c, ASTNode *n) {
+  switch (n->type) {
+  case AST_VAR:
+    emit(c, var(c, n->as.var.name));
+    return 1;
+  case AST_UNARY:
+    return fused_vars(c, n->as.unary.child);
+  case AST_BINARY: {
+    uint32_t left = fused_vars(c, n->as.binary.left);
+    return left + fused_vars(c, n->as.binary.right);
+  }
+  default:
+    return 0;
+  }
+}
+
+// A chain of two or more atomic verbs runs as one loop when its values
+// allow, and as the plain code that follows otherwise.
+static bool compile_fused(Compiler *c, ASTNode *n) {
+  size_t nodes = 0;
+  size_t verbs = c->plain ? 0 : fused_verbs(n, &nodes);
+  if (verbs < 2 || verbs == SIZE_MAX || nodes > FUSED_MAX)
+    return false;
+  emit(c, OP_FUSED);
+  emit(c, pool(c, n));
+  size_t done = c->len;
+  emit(c, 0);
+  size_t count = c->len;
+  emit(c, 0);
+  c->code[count] = fused_vars(c, n);
+  c->plain = true;
+  compile_node(c, n);
+  c->plain = false;
+  patch(c, done);
+  return true;
+}
+
+static void compile_node(Compiler *c, ASTNode *n) {
+  bool tail = c->tail;
+  c->tail = false;
+  if (n == NULL) {
+    emit(c, OP_NIL);
+    push(c, 1);
+    return;
+  }
+  if (compile_fused(c, n))
+    return;
+  switch (n->type) {
+  case AST_LITERAL: {
+    KObj *v = n->as.literal.value;
+    emit(c, !v ? OP_NIL : shareable(v) ? OP_CONST : OP_LITERAL);
+    if (v)
+      emit(c, pool(c, n));
+    push(c, 1);
+    return;
+  }
+  case AST_VAR:
+    emit(c, OP_GET);
+    emit(c, var(c, n->as.var.name));
+    push(c, 1);
+    return;
+  case AST_UNARY: {
+    TokenType op = n->as.unary.op.type;
+    bool verb = get_op_desc(op)->unary != NULL;
+    if (verb && n->as.unary.child && n->as.unary.child->type == AST_VAR) {
+      emit(c, OP_GET_UNARY);
+      emit(c, var(c, n->as.unary.child->as.var.name));
+      emit(c, op);
+      push(c, 1);
+      return;
+    }
+    compile_node(c, n->as.unary.child);
+    if (verb) {
+      emit(c, OP_UNARY);
+      emit(c, op);
+    } else {
+      emit(c, OP_NYI);
+      emit(c, 1);
+    }
+    return;
+  }
+  case AST_BINARY:
+    compile_binary(c, n);
+    return;
+  case AST_CONDITIONAL: {
+    compile_node(c, n->as.conditional.condition);
+    size_t other = jump(c, OP_JUMP_FALSE);
+    pop(c, 1);
+    c->tail = tail;
+    compile_node(c, n->as.conditional.then_branch);
+    size_t done = jump(c, OP_JUMP);
+    pop(c, 1);
+    patch(c, other);
+    c->tail = tail;
+    compile_node(c, n->as.conditional.else_branch);
+    patch(c, done);
+    return;
+  }
+  case AST_ADVERB:
+    compile_node(c, n->as.adverb.child);
+    emit(c, OP_ADVERB);
+    emit(c, pool(c, n));
+    return;
+  case AST_CALL:
+    compile_call(c, n, tail);
+    return;
+  case AST_SEQ:
+    c->tail = tail;
+    compile_seq(c, n->as.seq.items, n->as.seq.count);
+    return;
+  case AST_LIST:
+    for (size_t i = 0; i < n->as.seq.count; i++)
+      compile_guarded(c, n->as.seq.items[i]);
+    emit(c, OP_LIST);
+    emit(c, (uint32_t)n->as.seq.count);
+    pop(c, n->as.seq.count);
+    push(c, 1);
+    return;
+  }
+}
+
+// 1, 2 or 3 when x, y or z is the highest implicit parameter used.
+static int scan_node(ASTNode *n) {
+  if (!n)
+    return 0;
+  switch (n->type) {
+  case AST_VAR: {
+    const char *nm = n->as.var.name;
+    if (!nm)
+      return 0;
+    if (strcmp(nm, "x") == 0)
+      return 1;
+    if (strcmp(nm, "y") == 0)
+      return 2;
+    if (strcmp(nm, "z") == 0)
+      return 3;
+    return 0;
+  }
+  case AST_LITERAL:
+    return 0;
+  case AST_UNARY:
+    return scan_node(n->as.unary.child);
+  case AST_BINARY: {
+    int a = scan_node(n->as.binary.left);
+    int b = scan_node(n->as.binary.right);
+    return a > b ? a : b;
+  }
+  case AST_CALL: {
+    int m = scan_node(n->as.call.callee);
+    for (size_t i = 0; i < n->as.call.arg_count; i++) {
+      int t = scan_node(n->as.call.args[i]);
+      if (t > m)
+        m = t;
+    }
+    return m;
+  }
+  case AST_SEQ:
+  case AST_LIST: {
+    int m = 0;
+    for (size_t i = 0; i < n->as.seq.count; i++) {
+      int t = scan_node(n->as.seq.items[i]);
+      if (t > m)
+        m = t;
+    }
+    return m;
+  }
+  case AST_CONDITIONAL: {
+    int a = scan_node(n->as.conditional.condition);
+    int b = scan_node(n->as.conditional.then_branch);
+    int c = scan_node(n->as.conditional.else_branch);
+    int m = a > b ? a : b;
+    if (c > m)
+      m = c;
+    return m;
+  }
+  case AST_ADVERB:
+    return scan_node(n->as.adverb.child);
+  }
+  return 0;
+}
+
+// Every name the body assigns becomes a local of the lambda, except dotted
+// names, which always live in the global namespace.
+static void collect_locals(Compiler *c, ASTNode *n) {
+  if (!n)
+    return;
+  switch (n->type) {
+  case AST_VAR:
+  case AST_LITERAL:
+    return;
+  case AST_UNARY:
+    collect_locals(c, n->as.unary.child);
+    return;
+  case AST_BINARY: {
+    ASTNode *left = n->as.binary.left;
+    if (n->as.binary.op.type == COLON && left && left->type == AST_VAR &&
+        !strchr(left->as.var.name, '.') &&
+        local_slot(c, left->as.var.name) == VAR_LOCAL)
+      add_local(c, left->as.var.name);
+    collect_locals(c, left);
+    collect_locals(c, n->as.binary.right);
+    return;
+  }
+  case AST_CALL:
+    collect_locals(c, n->as.call.callee);
+    for (size_t i = 0; i < n->as.call.arg_count; i++)
+      collect_locals(c, n->as.call.args[i]);
+    return;
+  case AST_SEQ:
+  case AST_LIST:
+    for (size_t i = 0; i < n->as.seq.count; i++)
+      collect_locals(c, n->as.seq.items[i]);
+    return;
+  case AST_CONDITIONAL:
+    collect_locals(c, n->as.conditional.condition);
+    collect_locals(c, n->as.conditional.then_branch);
+    collect_locals(c, n->as.conditional.else_branch);
+    return;
+  case AST_ADVERB:
+    collect_locals(c, n->as.adverb.child);
+    return;
+  }
+}
+
+static Chunk *finish(Compiler *c, ASTNode **items, size_t count,
+                     Arena *arena) {
+  compile_seq(c, items, count);
+  emit(c, OP_RETURN);
+  Chunk *chunk = (Chunk *)arena_alloc(arena, sizeof(Chunk));
+  chunk->code = (uint32_t *)arena_alloc(arena, c->len * sizeof(uint32_t));
+  memcpy(chunk->code, c->code, c->len * sizeof(uint32_t));
+  chunk->pool = NULL;
+  if (c->pool_len) {
+    chunk->pool =
+        (const void **)arena_alloc(arena, c->pool_len * sizeof(void *));
+    memcpy((void *)chunk->pool, c->pool, c->pool_len * sizeof(void *));
+  }
+  chunk->guards = NULL;
+  if (c->guard_len) {
+    chunk->guards = (Guard *)arena_alloc(arena, c->guard_len * sizeof(Guard));
+    memcpy(chunk->guards, c->guards, c->guard_len * sizeof(Guard));
+  }
+  chunk->guard_count = c->guard_len;
+  chunk->sites = NULL;
+  if (c->site_len) {
+    chunk->sites =
+        (CallSite *)arena_alloc(arena, c->site_len * sizeof(CallSite));
+    memcpy(chunk->sites, c->sites, c->site_len * sizeof(CallSite));
+  }
+  chunk->site_count = c->site_len;
+  chunk->max_stack = c->max_depth;
+  chunk->arity = 0;
+  for (size_t i = 0; i < count; i++) {
+    int t = scan_node(items[i]);
+    if (t > chunk->arity)
+      chunk->arity = t;
+  }
+  chunk->names = NULL;
+  if (c->name_len) {
+    chunk->names =
+        (const char **)arena_alloc(arena, c->name_len * sizeof(char *));
+    memcpy((void *)chunk->names, c->names, c->name_len * sizeof(char *));
+  }
+  chunk->slot_count = c->name_len;
+  chunk->jit = NULL;
+  free(c->code);
+  free((void *)c->pool);
+  free(c->guards);
+  free(c->sites);
+  free((void *)c->names);
+  return chunk;
+}
+
+// Whether n applies only atomic verb forms to numbers and the first params
+// locals, so that it maps lists of numbers item by item; the locals it
+// reads are added to reads.
+static bool atomic_node(Compiler *c, ASTNode *n, size_t params,
+                        uint64_t *reads) {
+  if (!n)
+    return false;
+  switch (n->type) {
+  case AST_LITERAL:
+    return n->as.literal.value->type == INT ||
+           n->as.literal.value->type == FLOAT;
+  case AST_VAR: {
+    size_t slot = local_slot(c, n->as.var.name);
+    if (slot >= params || slot >= 64)
+      return false;
+    *reads |= (uint64_t)1 << slot;
+    return true;
+  }
+  case AST_UNARY:
+    return get_op_desc(n->as.unary.op.type)->atomic & ATOMIC_UNARY &&
+           atomic_node(c, n->as.unary.child, params, reads);
+  case AST_BINARY:
+    return get_op_desc(n->as.binary.op.type)->atomic & ATOMIC_BINARY &&
+           atomic_node(c, n->as.binary.left, params, reads) &&
+           atomic_node(c, n->as.binary.right, params, reads);
+  default:
+    return false;
+  }
+}
+
+Chunk *compile(ASTNode **items, size_t count, Arena *arena) {
+  Compiler c = {0};
+  for (size_t i = 0; i < count; i++)
+    optimize(items[i]);
+  Chunk *chunk = finish(&c, items, count, arena);
+  chunk->body = NULL;
+  chunk->body_count = 0;
+  chunk->atomic = false;
+  chunk->reads = 0;
+  return chunk;
+}
+
+Chunk *compile_lambda(KLambda *lam) {
+  // the lambda keeps its body as written, for display
+  Arena *outer = ast_arena;
+  ast_arena = &lam->arena;
+  ASTNode **body = (ASTNode **)arena_alloc(
+      &lam->arena, sizeof(ASTNode *) * (lam->body_count + 1));
+  for (size_t i = 0; i < lam->body_count; i++)
+    body[i] = optimize(copy_ast(lam->body[i]));
+  ast_arena = outer;
+  Compiler c = {0};
+  if (lam->param_count > 0) {
+    for (int i = 0; i < lam->param_count; i++)
+      add_local(&c, lam->params[i]);
+  } else {
+    add_local(&c, sym_intern("x", 1));
+    add_local(&c, sym_intern("y", 1));
+    add_local(&c, sym_intern("z", 1));
+  }
+  for (size_t i = 0; i < lam->body_count; i++)
+    collect_locals(&c, body[i]);
+  size_t params = lam->param_count > 0 ? (size_t)lam->param_count : 3;
+  uint64_t reads = 0;
+  bool atomic = lam->body_count == 1 && lam->has_return &&
+                atomic_node(&c, body[0], params, &reads);
+  c.tail = lam->has_return;
+  Chunk *chunk = finish(&c, body, lam->body_count, &lam->arena);
+  chunk->body = body;
+  chunk->body_count = lam->body_count;
+  chunk->atomic = atomic;
+  chunk->reads = reads;
+  return chunk;
+}
+
+void free_chunk(Chunk *chunk) {
+  jit_free(chunk->jit);
+  for (size_t i = 0; i < chunk->body_count; i++)
+    free_ast(chunk->body[i]);
+}
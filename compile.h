@@ -0,0 +1,115 @@
+#ifndef COMPILE_H_
+#define COMPILE_H_
+
+#include "arena.h"
+#include "ast.h"
+#include "def.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytecode for the stack machine in eval.c. Each instruction is an opcode
+// word followed by its operands; "node" operands index the chunk's pool,
+// which points into the AST the chunk was compiled from. A "var" operand
+// is either a pool index of a name, looked up at run time, or VAR_LOCAL
+// plus the slot of a local in the running lambda's frame.
+// Every instruction that pushes a value fails when that value is nil:
+// the machine then unwinds to the innermost guard around it, or out of
+// the chunk when there is none.
+typedef enum {
+  OP_NIL,          // push nil
+  OP_CONST,        // node: push a literal
+  OP_LITERAL,      // node: push a fresh copy of a literal list with nils
+  OP_GET,          // var: push a variable
+  OP_SET,          // var: bind the top value, keeping it
+  OP_POP,          //
+  OP_UNARY,        // op: apply the verb for token type op
+  OP_BINARY,       // op
+  OP_NYI,          // n: drop n operands of a verb that lacks the form
+  OP_JUMP,         // target
+  OP_JUMP_FALSE,   // target: pop a condition
+  OP_LIST,         // n: collect the top n values
+  OP_ADVERB,       // node: wrap the top value in an adverb
+  OP_CALL,         // n site: call or index the value under n arguments
+  OP_PLACE,        // i n: move the first of n arguments to position i
+  OP_UNLESS_ADVERB, // target: jump when the callee on top is no adverb
+  OP_GET_UNIQUE,   // var dicts: push a variable for amending in place
+  OP_CHECK_INT,    // fail unless the top value is an int
+  OP_AMEND,        // v[i]:x
+  OP_AMEND_WALK,   // n: v[i;j;...] down to the last index
+  OP_AMEND_SET,    // store into the result of OP_AMEND_WALK
+  OP_SELF_UPDATE,  // var node: x:x op y or x:op x, y already pushed
+  OP_ASSIGN_ERROR, //
+  OP_RETURN,       //
+  // superinstructions for common shapes
+  OP_GET_UNARY,        // var op: op x
+  OP_GET_GET_BINARY,   // var var op: x op y
+  OP_GET_CONST_BINARY, // var node op: x op 1
+  OP_CONST_GET_BINARY, // node var op: 1 op x
+  OP_GET_GET_CALL,     // var var site: f[x] or v[i]
+  OP_GET_CONST_CALL,   // var node site: f[1] or v[0]
+  OP_CALL_ADVERB,      // node n: f/ f' ... applied without an adverb object
+  OP_FUSED, // node target n var...: k_fused over the n variables, then jump
+            // to target; falls through to plain code for node when it fails
+} OpCode;
+
+#define VAR_LOCAL 0x80000000u
+
+// Unwinding target for a failure between start and end: the stack is cut
+// back to depth, nil pushed in place of the failed value, and execution
+// resumes at end. List items and all but the last item of a sequence or
+// body are guarded, since a failed one does not end its container.
+typedef struct {
+  uint32_t start, end, depth;
+} Guard;
+
+// A call instruction's cache. When its callee is a global lambda called in
+// full, it keeps which global, the version the global had and what calling
+// the lambda takes, and later calls of that same lambda skip resolving it
+// again. Reassigning the global bumps its version, which voids the cache.
+typedef struct {
+  const char *name; // the callee's name when it is a global, else NULL
+  bool tail;        // the lambda returns the call's value
+  bool reuse;       // a tail call can run in the caller's frame
+  uint32_t entry;   // the global + 1, 0 while nothing is cached
+  uint32_t bind;    // arguments bound to locals
+  uint64_t version;
+  const void *fn;   // the KObj the global held
+} CallSite;
+
+typedef struct Chunk {
+  uint32_t *code;
+  const void **pool;
+  Guard *guards;
+  size_t guard_count;
+  CallSite *sites;
+  size_t site_count;
+  size_t max_stack;
+  int arity; // highest of x, y and z used, for lambdas without params
+  // Locals of a lambda body by slot: its parameters, or x, y and z when
+  // it has none, then every name it assigns. Empty for a statement.
+  const char **names;
+  size_t slot_count;
+  // The optimised copy of a lambda body the pool points into; NULL for a
+  // statement, which is optimised in place.
+  ASTNode **body;
+  size_t body_count;
+  // The lambda is one expression of atomic verb forms over its parameters
+  // and numbers, so applying it to lists is applying it item by item.
+  bool atomic;
+  uint64_t reads; // bit i when an atomic body reads parameter i
+  struct JitCode *jit; // native code for the lambda, see jit.h
+} Chunk;
+
+// Compiles items as a sequence whose value is the last one's, into memory
+// taken from arena.
+Chunk *compile(ASTNode **items, size_t count, Arena *arena);
+
+// Compiles an optimised copy of the body of lam into its arena, with its
+// locals in slots.
+Chunk *compile_lambda(KLambda *lam);
+
+// Releases what the chunk of a lambda holds outside its arena.
+void free_chunk(Chunk *chunk);
+
+#endif
@@ -1,92 +1,138 @@
 #include "def.h"
-#include "arena.h"
 #include "ast.h"
+#include "compile.h"
+#include "slab.h"
+#include "sym.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static char *k_strdup_local(const char *s) {
-  size_t len = strlen(s);
-  char *res = (char *)arena_alloc(&global_arena, len + 1);
-  if (!res)
-    return NULL;
-  memcpy(res, s, len + 1);
-  return res;
+// Objects own their storage: every KObj and the payload hanging off it comes
+// from the slab allocator and is given back by release_object once the last
+// reference is dropped. Parse trees live in arenas instead (see ast_arena).
+void oom(void) {
+  fprintf(stderr, "^oom\n");
+  exit(1);
 }
 
+static inline void *obj_alloc(size_t size) {
+  void *p = slab_alloc(size);
+  if (!p)
+    oom();
+  return p;
+}
+
+static inline void obj_free(void *p, size_t size) { slab_free(p, size); }
+
+size_t live_objects[PROJ + 1];
+
 KObj *create_object(KType type) {
-  KObj *obj = (KObj *)arena_alloc(&global_arena, sizeof(KObj));
-  if (!obj) {
-    fprintf(stderr, "^oom\n");
-    exit(1);
-  }
+  live_objects[type]++;
+  KObj *obj = (KObj *)obj_alloc(sizeof(KObj));
   obj->type = type;
   obj->ref_count = 1;
   return obj;
 }
 
-void retain_object(KObj *obj) {
-  if (obj) {
-    obj->ref_count++;
-  }
-}
-
-void release_object(KObj *obj) {
-  if (!obj) {
-    return;
-  }
-  obj->ref_count--;
-  if (obj->ref_count == 0) {
-    switch (obj->type) {
-    case VECTOR:
-      for (size_t i = 0; i < obj->as.vector->length; i++) {
-        release_object(&obj->as.vector->items[i]);
-      }
-      break;
-    case DICT:
-      release_object(obj->as.dict->keys);
-      release_object(obj->as.dict->values);
-      break;
-    case LAMBDA:
-      break;
-    case ADVERB:
-      release_object(obj->as.adverb->child);
-      break;
-    case PROJ:
-      if (obj->as.proj) {
-        if (obj->as.proj->fn)
-          release_object(obj->as.proj->fn);
-        if (obj->as.proj->args) {
-          for (size_t i = 0; i < obj->as.proj->argn; i++) {
-            if (obj->as.proj->args[i])
-              release_object(obj->as.proj->args[i]);
-          }
-          free(obj->as.proj->args);
-        }
-      }
-      break;
-    default:
-      break;
+static KObj nil_obj, pinf_obj, ninf_obj;
+static KObj char_objs[256];
+static KObj small_ints[K_SMALL_INT_MAX - K_SMALL_INT_MIN + 1];
+
+static void init_immortal(KObj *obj, KType type) {
+  obj->type = type;
+  obj->ref_count = K_IMMORTAL;
+}
+
+void scalars_init(void) {
+  init_immortal(&nil_obj, NIL);
+  init_immortal(&pinf_obj, PINF);
+  init_immortal(&ninf_obj, NINF);
+  for (int i = 0; i < 256; i++) {
+    init_immortal(&char_objs[i], CHAR);
+    char_objs[i].as.char_value = (char)i;
+  }
+  for (int64_t i = K_SMALL_INT_MIN; i <= K_SMALL_INT_MAX; i++) {
+    init_immortal(&small_ints[i - K_SMALL_INT_MIN], INT);
+    small_ints[i - K_SMALL_INT_MIN].as.int_value = i;
+  }
+}
+
+static size_t elem_size(KType elem);
+
+static void free_vector(KVec *vec) {
+  if (vec->base) {
+    release_object(vec->base);
+    obj_free(vec, sizeof(KVec));
+    return;
+  }
+  if (vec->elem == NIL) {
+    for (size_t i = 0; i < vec->length; i++) {
+      release_object(vec->items[i]);
     }
   }
+  obj_free(vec->items, vec->capacity * elem_size(vec->elem));
+  obj_free(vec, sizeof(KVec));
 }
 
-KObj *create_nil() {
-  KObj *obj = create_object(NIL);
-  return obj;
+static void free_proj(KProj *proj) {
+  if (proj->fn)
+    release_object(proj->fn);
+  if (proj->args) {
+    for (size_t i = 0; i < proj->argn; i++) {
+      if (proj->args[i])
+        release_object(proj->args[i]);
+    }
+    obj_free(proj->args, sizeof(KObj *) * proj->argn);
+  }
+  obj_free(proj, sizeof(KProj));
 }
 
+// Called by release_object once the last reference is gone.
+void free_object(KObj *obj) {
+  switch (obj->type) {
+  case VECTOR:
+    free_vector(obj->as.vector);
+    break;
+  case DICT:
+    release_object(obj->as.dict->keys);
+    release_object(obj->as.dict->values);
+    free(obj->as.dict->index);
+    obj_free(obj->as.dict, sizeof(KDict));
+    break;
+  case LAMBDA:
+    for (size_t i = 0; i < obj->as.lambda->body_count; i++)
+      free_ast(obj->as.lambda->body[i]);
+    if (obj->as.lambda->code)
+      free_chunk(obj->as.lambda->code);
+    arena_reset(&obj->as.lambda->arena);
+    obj_free(obj->as.lambda, sizeof(KLambda));
+    break;
+  case ADVERB:
+    release_object(obj->as.adverb->child);
+    obj_free(obj->as.adverb, sizeof(KAdverb));
+    break;
+  case PROJ:
+    if (obj->as.proj)
+      free_proj(obj->as.proj);
+    break;
+  default:
+    break;
+  }
+  live_objects[obj->type]--;
+  obj_free(obj, sizeof(KObj));
+}
+
+KObj *create_nil() { return &nil_obj; }
+
 KObj *create_int(int64_t value) {
+  if (value >= K_SMALL_INT_MIN && value <= K_SMALL_INT_MAX)
+    return &small_ints[value - K_SMALL_INT_MIN];
   KObj *obj = create_object(INT);
   obj->as.int_value = value;
   return obj;
 }
 
-KObj *create_char(char value) {
-  KObj *obj = create_object(CHAR);
-  obj->as.char_value = value;
-  return obj;
-}
+KObj *create_char(char value) { return &char_objs[(unsigned char)value]; }
 
 KObj *create_float(double value) {
   KObj *obj = create_object(FLOAT);
@@ -94,104 +140,373 @@ KObj *create_float(double value) {
   return obj;
 }
 
-KObj *create_pinf() { return create_object(PINF); }
+KObj *create_pinf() { return &pinf_obj; }
 
-KObj *create_ninf() { return create_object(NINF); }
+KObj *create_ninf() { return &ninf_obj; }
 
-KObj *create_vec(size_t capacity) {
+static bool is_flat_type(KType type) {
+  return type == INT || type == FLOAT || type == CHAR || type == SYM;
+}
+
+static size_t elem_size(KType elem) {
+  switch (elem) {
+  case INT:
+    return sizeof(int64_t);
+  case FLOAT:
+    return sizeof(double);
+  case CHAR:
+    return sizeof(char);
+  case SYM:
+    return sizeof(uint32_t);
+  default:
+    return sizeof(KObj *);
+  }
+}
+
+KObj *create_typed_vec(KType elem, size_t capacity) {
   KObj *obj = create_object(VECTOR);
-  obj->as.vector = (KVec *)arena_alloc(&global_arena, sizeof(KVec));
-  if (!obj->as.vector) {
-    fprintf(stderr, "^oom\n");
-    return NULL;
+  KVec *vec = (KVec *)obj_alloc(sizeof(KVec));
+  obj->as.vector = vec;
+  vec->length = 0;
+  vec->capacity = capacity;
+  vec->elem = is_flat_type(elem) ? elem : NIL;
+  vec->attr = 0;
+  vec->base = NULL;
+  vec->items =
+      (capacity > 0) ? obj_alloc(capacity * elem_size(vec->elem)) : NULL;
+  return obj;
+}
+
+// elem must be INT or FLOAT and length non-zero.
+KObj *create_range(KType elem, KNum from, KNum by, size_t length) {
+  KObj *obj = create_typed_vec(elem, 0);
+  KVec *vec = obj->as.vector;
+  vec->from = from;
+  vec->by = by;
+  vec->length = length;
+  if (elem == INT) {
+    int64_t span, last;
+    if (__builtin_mul_overflow(by.i, (int64_t)(length - 1), &span) ||
+        __builtin_add_overflow(from.i, span, &last))
+      vec->attr = 0;
+    else if (by.i == 0)
+      vec->attr = length == 1 ? ATTR_ALL : ATTR_SORTED | ATTR_GROUPED;
+    else
+      vec->attr = by.i > 0 ? ATTR_ALL : ATTR_UNIQUE | ATTR_GROUPED;
+  } else if (by.f >= 0 && from.f == from.f) {
+    // rounding can make neighbouring items equal, so never unique
+    vec->attr = ATTR_SORTED | ATTR_GROUPED;
   }
-  obj->as.vector->length = 0;
+  return obj;
+}
+
+// Storage is allocated on first append, once the element type is known;
+// capacity is kept as a sizing hint until then.
+KObj *create_vec(size_t capacity) {
+  KObj *obj = create_typed_vec(NIL, 0);
   obj->as.vector->capacity = capacity;
-  obj->as.vector->items =
-      (capacity > 0)
-          ? (KObj *)arena_alloc(&global_arena, capacity * sizeof(KObj))
-          : NULL;
-  if (!obj->as.vector->items && capacity > 0) {
-    fprintf(stderr, "^oom\n");
-    return NULL;
-  }
   return obj;
 }
 
 KObj *create_symbol(const char *name) {
   KObj *obj = create_object(SYM);
-  obj->as.symbol_value = k_strdup_local(name);
+  obj->as.symbol_value = sym_intern(name, strlen(name));
   return obj;
 }
 
 KObj *create_dict(KObj *keys, KObj *values) {
   KObj *obj = create_object(DICT);
-  obj->as.dict = (KDict *)arena_alloc(&global_arena, sizeof(KDict));
-  if (!obj->as.dict) {
-    fprintf(stderr, "^oom\n");
-    return NULL;
-  }
+  obj->as.dict = (KDict *)obj_alloc(sizeof(KDict));
+  vector_force(keys);
+  vector_force(values);
   obj->as.dict->keys = keys;
   obj->as.dict->values = values;
+  obj->as.dict->index = NULL;
+  obj->as.dict->slots = 0;
   retain_object(keys);
   retain_object(values);
   return obj;
 }
 
-// Retain subobjects for a copied KObj placed inline in a vector.
-static void retain_subobjects(KObj *obj) {
-  if (!obj)
-    return;
-  switch (obj->type) {
-  case VECTOR: {
-    KVec *v = obj->as.vector;
-    for (size_t j = 0; j < v->length; j++) {
-      retain_object(&v->items[j]);
+static int64_t range_int(const KVec *vec, size_t i) {
+  return (int64_t)((uint64_t)vec->from.i + (uint64_t)i * (uint64_t)vec->by.i);
+}
+
+static double range_float(const KVec *vec, size_t i) {
+  return vec->by.f == 0 ? vec->from.f : vec->from.f + (double)i * vec->by.f;
+}
+
+// Give a view or a virtual vector storage of its own, taking its own
+// references to boxed items.
+static void vector_detach(KVec *vec) {
+  if (!vec->items && vec->length > 0) {
+    vec->items = obj_alloc(vec->length * sizeof(int64_t));
+    vec->capacity = vec->length;
+    for (size_t i = 0; i < vec->length; i++) {
+      if (vec->elem == INT)
+        vec->ints[i] = range_int(vec, i);
+      else
+        vec->floats[i] = range_float(vec, i);
     }
-  } break;
-  case DICT:
-    retain_object(obj->as.dict->keys);
-    retain_object(obj->as.dict->values);
+    return;
+  }
+  if (!vec->base)
+    return;
+  size_t size = elem_size(vec->elem);
+  void *items = obj_alloc(vec->length * size);
+  memcpy(items, vec->items, vec->length * size);
+  if (vec->elem == NIL) {
+    for (size_t i = 0; i < vec->length; i++)
+      retain_object(((KObj **)items)[i]);
+  }
+  release_object(vec->base);
+  vec->base = NULL;
+  vec->items = (KObj **)items;
+  vec->capacity = vec->length;
+}
+
+static void vector_reserve(KVec *vec, size_t need) {
+  vector_detach(vec);
+  if (vec->items && need <= vec->capacity)
+    return;
+  size_t new_capacity = vec->items ? vec->capacity * 2 : vec->capacity;
+  if (new_capacity < need)
+    new_capacity = need;
+  if (new_capacity < 8)
+    new_capacity = 8;
+  size_t size = elem_size(vec->elem);
+  void *new_items = obj_alloc(new_capacity * size);
+  if (vec->items && vec->length > 0)
+    memcpy(new_items, vec->items, vec->length * size);
+  if (vec->items)
+    obj_free(vec->items, vec->capacity * size);
+  vec->items = (KObj **)new_items;
+  vec->capacity = new_capacity;
+}
+
+static KObj *flat_load(KVec *vec, size_t index) {
+  switch (vec->elem) {
+  case INT:
+    return create_int(vec->ints[index]);
+  case FLOAT:
+    return create_float(vec->floats[index]);
+  case SYM: {
+    KObj *obj = create_object(SYM);
+    obj->as.symbol_value = sym_name(vec->syms[index]);
+    return obj;
+  }
+  default:
+    return create_char(vec->chars[index]);
+  }
+}
+
+static void flat_store(KVec *vec, size_t index, KObj *src) {
+  switch (vec->elem) {
+  case INT:
+    vec->ints[index] = src->as.int_value;
     break;
-  case ADVERB:
-    retain_object(obj->as.adverb->child);
+  case FLOAT:
+    vec->floats[index] = src->as.float_value;
     break;
-  case PROJ:
-    if (obj->as.proj) {
-      if (obj->as.proj->fn)
-        retain_object(obj->as.proj->fn);
-      for (size_t i = 0; i < obj->as.proj->argn; i++) {
-        if (obj->as.proj->args && obj->as.proj->args[i])
-          retain_object(obj->as.proj->args[i]);
-      }
-    }
+  case SYM:
+    vec->syms[index] = sym_id(src->as.symbol_value);
     break;
   default:
+    vec->chars[index] = src->as.char_value;
     break;
   }
 }
 
+// Order of flat items a and b as ^ sorts them: negative, zero or positive,
+// and positive as well when a NaN makes them unordered.
+static int flat_order(const KVec *vec, size_t a, size_t b) {
+  switch (vec->elem) {
+  case INT:
+    return (vec->ints[a] > vec->ints[b]) - (vec->ints[a] < vec->ints[b]);
+  case FLOAT:
+    return vec->floats[a] < vec->floats[b]    ? -1
+           : vec->floats[a] == vec->floats[b] ? 0
+                                              : 1;
+  case SYM:
+    return sym_cmp(sym_name(vec->syms[a]), sym_name(vec->syms[b]));
+  default:
+    return ((unsigned char)vec->chars[a] > (unsigned char)vec->chars[b]) -
+           ((unsigned char)vec->chars[a] < (unsigned char)vec->chars[b]);
+  }
+}
+
+// A run with attributes run was just appended at position at: an empty
+// vector takes the run's attributes, otherwise only what still holds
+// across the seam is kept.
+static void attr_extend(KVec *vec, size_t at, uint8_t run) {
+  if (at > 0 && !vec->attr)
+    return;
+  if (vec->elem == NIL) {
+    vec->attr = 0;
+    return;
+  }
+  if (at == 0) {
+    vec->attr = run;
+    return;
+  }
+  uint8_t both = vec->attr & run;
+  vec->attr = 0;
+  if (!(both & ATTR_SORTED))
+    return;
+  int c = flat_order(vec, at - 1, at);
+  if (c < 0)
+    vec->attr = both;
+  else if (c == 0)
+    vec->attr = both & ~ATTR_UNIQUE;
+}
+
+// Convert flat storage to boxed items in place.
+static void vector_box(KVec *vec) {
+  if (vec->elem == NIL)
+    return;
+  vector_detach(vec);
+  size_t capacity = vec->capacity > vec->length ? vec->capacity : vec->length;
+  if (capacity == 0)
+    capacity = 8;
+  KObj **items = (KObj **)obj_alloc(capacity * sizeof(KObj *));
+  for (size_t i = 0; i < vec->length; i++)
+    items[i] = flat_load(vec, i);
+  obj_free(vec->items, vec->capacity * elem_size(vec->elem));
+  vec->items = items;
+  vec->capacity = capacity;
+  vec->elem = NIL;
+  vec->attr = 0;
+}
+
+// Make vec able to hold an item of the given type, retyping an empty
+// vector or boxing a flat one that is about to become mixed.
+static void vector_accept(KVec *vec, KType type) {
+  KType want = is_flat_type(type) ? type : NIL;
+  if (vec->elem == want)
+    return;
+  vector_detach(vec);
+  if (vec->length == 0) {
+    // storage is sized for the old type; the capacity stays as a hint
+    if (vec->items) {
+      obj_free(vec->items, vec->capacity * elem_size(vec->elem));
+      vec->items = NULL;
+    }
+    vec->elem = want;
+    return;
+  }
+  vector_box(vec);
+}
+
+void vector_force(KObj *vec_obj) {
+  if (is_virtual(vec_obj))
+    vector_detach(vec_obj->as.vector);
+}
+
+KObj *vector_get(KObj *vec_obj, size_t index) {
+  KVec *vec = vec_obj->as.vector;
+  if (!vec->items)
+    return vec->elem == INT ? create_int(range_int(vec, index))
+                            : create_float(range_float(vec, index));
+  if (vec->elem != NIL)
+    return flat_load(vec, index);
+  retain_object(vec->items[index]);
+  return vec->items[index];
+}
+
 void vector_append(KObj *vec_obj, KObj *item) {
   if (vec_obj->type != VECTOR) {
     return;
   }
+  vector_force(item);
   KVec *vec = vec_obj->as.vector;
-  if (vec->length >= vec->capacity) {
-    size_t new_capacity = vec->capacity * 2;
-    if (new_capacity == 0)
-      new_capacity = 8;
-    KObj *new_items =
-        (KObj *)arena_alloc(&global_arena, new_capacity * sizeof(KObj));
-    if (vec->items && vec->length > 0) {
-      memcpy(new_items, vec->items, vec->length * sizeof(KObj));
-    }
-    vec->items = new_items;
-    vec->capacity = new_capacity;
+  vector_accept(vec, item->type);
+  vector_reserve(vec, vec->length + 1);
+  if (vec->elem != NIL) {
+    flat_store(vec, vec->length++, item);
+    attr_extend(vec, vec->length - 1, ATTR_ALL);
+    return;
   }
-  vec->items[vec->length] = *item;
-  vec->items[vec->length].ref_count = 1;
-  retain_subobjects(&vec->items[vec->length]);
-  vec->length++;
+  retain_object(item);
+  vec->items[vec->length++] = item;
+}
+
+void vector_append_from(KObj *vec_obj, KObj *src, size_t index) {
+  KVec *vec = vec_obj->as.vector;
+  KVec *from = src->as.vector;
+  if (from->items && from->elem != NIL &&
+      (vec->elem == from->elem || vec->length == 0)) {
+    vector_accept(vec, from->elem);
+    vector_reserve(vec, vec->length + 1);
+    size_t size = elem_size(vec->elem);
+    memcpy((char *)vec->items + vec->length * size,
+           (char *)from->items + index * size, size);
+    attr_extend(vec, vec->length++, ATTR_ALL);
+    return;
+  }
+  KObj *item = vector_get(src, index);
+  vector_append(vec_obj, item);
+  release_object(item);
+}
+
+// Append src[from, from + n), copying a flat run with one memcpy.
+void vector_append_range(KObj *vec_obj, KObj *src, size_t from, size_t n) {
+  KVec *vec = vec_obj->as.vector;
+  KVec *s = src->as.vector;
+  if (n == 0)
+    return;
+  if (s->items && s->elem != NIL &&
+      (vec->elem == s->elem || vec->length == 0)) {
+    vector_accept(vec, s->elem);
+    vector_reserve(vec, vec->length + n);
+    size_t size = elem_size(vec->elem);
+    memcpy((char *)vec->items + vec->length * size,
+           (char *)s->items + from * size, n * size);
+    vec->length += n;
+    attr_extend(vec, vec->length - n, n == 1 ? ATTR_ALL : s->attr);
+    return;
+  }
+  for (size_t i = 0; i < n; i++)
+    vector_append_from(vec_obj, src, from + i);
+}
+
+// Shallow copy: boxed items are shared with the original.
+KObj *vector_copy(KObj *vec_obj) {
+  KVec *from = vec_obj->as.vector;
+  if (is_virtual(vec_obj))
+    return create_range(from->elem, from->from, from->by, from->length);
+  KObj *copy = create_typed_vec(from->elem, from->length);
+  KVec *vec = copy->as.vector;
+  if (from->length > 0)
+    memcpy(vec->items, from->items, from->length * elem_size(from->elem));
+  if (from->elem == NIL) {
+    for (size_t i = 0; i < from->length; i++)
+      retain_object(vec->items[i]);
+  }
+  vec->length = from->length;
+  vec->attr = from->attr;
+  return copy;
+}
+
+// Elements [offset, offset + length) of vec_obj without copying them.
+KObj *vector_view(KObj *vec_obj, size_t offset, size_t length) {
+  KVec *from = vec_obj->as.vector;
+  if (is_virtual(vec_obj)) {
+    KNum start = from->from;
+    if (from->elem == INT)
+      start.i = range_int(from, offset);
+    else
+      start.f = range_float(from, offset);
+    return create_range(from->elem, start, from->by, length);
+  }
+  KObj *base = from->base ? from->base : vec_obj;
+  KObj *view = create_typed_vec(from->elem, 0);
+  KVec *vec = view->as.vector;
+  vec->items = (KObj **)((char *)from->items + offset * elem_size(from->elem));
+  vec->length = length;
+  vec->attr = from->attr;
+  vec->base = base;
+  retain_object(base);
+  return view;
 }
 
 void vector_set(KObj *vec_obj, size_t index, KObj *src) {
@@ -200,21 +515,34 @@ void vector_set(KObj *vec_obj, size_t index, KObj *src) {
   KVec *vec = vec_obj->as.vector;
   if (index >= vec->length)
     return;
-  release_object(&vec->items[index]);
-  vec->items[index] = *src;
-  vec->items[index].ref_count = 1;
-  retain_subobjects(&vec->items[index]);
+  vector_force(src);
+  vector_detach(vec);
+  vec->attr = 0;
+  if (vec->elem != NIL) {
+    if (src->type == vec->elem) {
+      flat_store(vec, index, src);
+      return;
+    }
+    vector_box(vec);
+  }
+  retain_object(src);
+  release_object(vec->items[index]);
+  vec->items[index] = src;
 }
 
+// Takes over the arena params and body were parsed into.
 KObj *create_lambda(int param_count, char **params, ASTNode **body,
-                    size_t body_count, bool has_return) {
+                    size_t body_count, bool has_return, Arena *arena) {
   KObj *obj = create_object(LAMBDA);
-  obj->as.lambda = (KLambda *)arena_alloc(&global_arena, sizeof(KLambda));
+  obj->as.lambda = (KLambda *)obj_alloc(sizeof(KLambda));
   obj->as.lambda->param_count = param_count;
   obj->as.lambda->params = params;
   obj->as.lambda->body = body;
   obj->as.lambda->body_count = body_count;
   obj->as.lambda->has_return = has_return;
+  obj->as.lambda->code = NULL;
+  obj->as.lambda->arena = *arena;
+  arena_init(arena);
   return obj;
 }
 
@@ -228,13 +556,13 @@ KObj *create_verb(UnaryFunc unary, BinaryFunc binary, Token op) {
 
 KObj *create_projection(KObj *fn, KObj **args, size_t argn, size_t arity) {
   KObj *obj = create_object(PROJ);
-  obj->as.proj = (KProj *)arena_alloc(&global_arena, sizeof(KProj));
+  obj->as.proj = (KProj *)obj_alloc(sizeof(KProj));
   obj->as.proj->fn = fn;
   obj->as.proj->arity = arity;
   obj->as.proj->argn = argn;
   retain_object(fn);
   if (argn > 0) {
-    obj->as.proj->args = (KObj **)malloc(sizeof(KObj *) * argn);
+    obj->as.proj->args = (KObj **)obj_alloc(sizeof(KObj *) * argn);
     for (size_t i = 0; i < argn; i++) {
       obj->as.proj->args[i] = args[i];
       retain_object(args[i]);
@@ -244,3 +572,55 @@ KObj *create_projection(KObj *fn, KObj **args, size_t argn, size_t arity) {
   }
   return obj;
 }
+
+KObj *create_adverb(Token op, KObj *child) {
+  KObj *obj = create_object(ADVERB);
+  obj->as.adverb = (KAdverb *)obj_alloc(sizeof(KAdverb));
+  obj->as.adverb->op = op;
+  obj->as.adverb->child = child;
+  return obj;
+}
+
+// Bytes reachable from obj, counting a shared child once per reference.
+size_t obj_footprint(KObj *obj) {
+  if (!obj)
+    return 0;
+  size_t size = sizeof(KObj);
+  switch (obj->type) {
+  case VECTOR: {
+    KVec *vec = obj->as.vector;
+    size += sizeof(KVec);
+    if (vec->base)
+      break; // the elements are counted with base
+    if (vec->items)
+      size += vec->capacity * elem_size(vec->elem);
+    if (vec->elem == NIL) {
+      for (size_t i = 0; i < vec->length; i++)
+        size += obj_footprint(vec->items[i]);
+    }
+    break;
+  }
+  case DICT:
+    size += sizeof(KDict) + obj->as.dict->slots * sizeof(size_t) +
+            obj_footprint(obj->as.dict->keys) +
+            obj_footprint(obj->as.dict->values);
+    break;
+  case LAMBDA:
+    size += sizeof(KLambda) + arena_size(&obj->as.lambda->arena);
+    break;
+  case ADVERB:
+    size += sizeof(KAdverb) + obj_footprint(obj->as.adverb->child);
+    break;
+  case PROJ: {
+    KProj *proj = obj->as.proj;
+    size += sizeof(KProj) + proj->argn * sizeof(KObj *) +
+            obj_footprint(proj->fn);
+    for (size_t i = 0; i < proj->argn; i++)
+      size += obj_footprint(proj->args[i]);
+    break;
+  }
+  default:
+    break;
+  }
+  return size;
+}
@@ -1,5 +1,6 @@
 #ifndef DEF_H_
 #define DEF_H_
+#include "arena.h"
 #include "token.h"
 #include <stdbool.h>
 #include <stddef.h>
@@ -49,15 +50,49 @@ struct KAdverb {
   KObj *child;
 };
 
+typedef union {
+  int64_t i;
+  double f;
+} KNum;
+
+// A view (base set) borrows a contiguous run of base's storage: items
+// points into base, which it keeps alive, and it owns no buffer.
+// A virtual vector (items NULL, length > 0) stores nothing: element i of
+// an INT or FLOAT virtual vector is from + i * by. Vector mutators give
+// either kind storage of its own first, and vector_force does so for
+// code that reads items directly.
 struct KVec {
   size_t length;
   size_t capacity;
-  KObj *items;
+  KType elem; // INT, FLOAT, CHAR or SYM when stored flat, NIL when boxed
+  uint8_t attr; // ATTR_* facts about a flat vector's items
+  KObj *base;
+  KNum from, by; // virtual vectors only
+  union {
+    KObj **items; // boxed
+    int64_t *ints;
+    double *floats;
+    char *chars;
+    uint32_t *syms; // interned symbol ids
+  };
 };
 
+// Attributes are established by the producers that know them and kept up
+// by appends, which check the seam; any other write clears them. Sorted
+// means ascending in the order ^ uses, and unique implies grouped.
+#define ATTR_SORTED 1  // x[i] <= x[i+1]
+#define ATTR_UNIQUE 2  // no item repeats
+#define ATTR_GROUPED 4 // equal items are adjacent
+#define ATTR_ALL (ATTR_SORTED | ATTR_UNIQUE | ATTR_GROUPED)
+#define ATTR_BOOL 8    // every item is 0 or 1, as comparisons yield
+
+// index is a hash of the keys built by the first lookup (see dict_find);
+// it stays NULL for dicts that are never looked up.
 struct KDict {
   KObj *keys;
   KObj *values;
+  size_t *index;
+  size_t slots;
 };
 
 struct KLambda {
@@ -66,6 +101,8 @@ struct KLambda {
   ASTNode **body;
   size_t body_count;
   bool has_return;
+  struct Chunk *code; // compiled body, built on the first call
+  Arena arena;         // owns params, body and code
 };
 
 struct KObj {
@@ -75,7 +112,7 @@ struct KObj {
     int64_t int_value;
     double float_value;
     char char_value;
-    const char *symbol_value;
+    const char *symbol_value; // interned, see sym.h
     KVec *vector;
     KDict *dict;
     KLambda *lambda;
@@ -85,9 +122,32 @@ struct KObj {
   } as;
 };
 
+// Preallocated scalars (nil, infinities, chars and small ints) are shared
+// by every create_* call that asks for them. Their count starts far above
+// anything live references can add or remove, so it never reaches zero and
+// never reads as uniquely owned.
+#define K_IMMORTAL (1u << 31)
+#define K_SMALL_INT_MIN -256
+#define K_SMALL_INT_MAX 1023
+
+extern size_t live_objects[PROJ + 1]; // heap objects by type
+
+// Reports that memory ran out and exits; for allocations outside objects
+// that the caller cannot recover from.
+void oom(void);
+void scalars_init(void);
 KObj *create_object(KType type);
-void retain_object(KObj *obj);
-void release_object(KObj *obj);
+void free_object(KObj *obj);
+
+static inline void retain_object(KObj *obj) {
+  if (obj)
+    obj->ref_count++;
+}
+
+static inline void release_object(KObj *obj) {
+  if (obj && --obj->ref_count == 0)
+    free_object(obj);
+}
 
 KObj *create_nil();
 KObj *create_int(int64_t value);
@@ -96,12 +156,27 @@ KObj *create_float(double value);
 KObj *create_pinf();
 KObj *create_ninf();
 KObj *create_vec(size_t capacity);
+KObj *create_typed_vec(KType elem, size_t capacity);
+KObj *create_range(KType elem, KNum from, KNum by, size_t length);
 KObj *create_symbol(const char *name);
 KObj *create_dict(KObj *keys, KObj *values);
 KObj *create_lambda(int param_count, char **params, ASTNode **body,
-                    size_t body_count, bool has_return);
+                    size_t body_count, bool has_return, Arena *arena);
 KObj *create_verb(UnaryFunc unary, BinaryFunc binary, Token op);
+KObj *create_adverb(Token op, KObj *child);
+KObj *vector_get(KObj *vec, size_t index);
 void vector_append(KObj *vec, KObj *item);
+void vector_append_from(KObj *vec, KObj *src, size_t index);
+void vector_append_range(KObj *vec, KObj *src, size_t from, size_t n);
 void vector_set(KObj *vec, size_t index, KObj *src);
+KObj *vector_copy(KObj *vec);
+KObj *vector_view(KObj *vec, size_t offset, size_t length);
+void vector_force(KObj *vec);
+
+static inline bool is_virtual(const KObj *obj) {
+  return obj->type == VECTOR && !obj->as.vector->items &&
+         obj->as.vector->length > 0;
+}
 KObj *create_projection(KObj *fn, KObj **args, size_t argn, size_t arity);
+size_t obj_footprint(KObj *obj);
 #endif
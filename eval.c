@@ -2,87 +2,413 @@
 #include "arena.h"
 #include "ast.h"
 #include "builtins.h"
+#include "compile.h"
 #include "def.h"
+#include "jit.h"
+#include "sym.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-static int scan_node(ASTNode *n);
 #include "ops.h"
 #include "repl.h"
 
-static char *k_strdup_local(const char *s) {
-  size_t len = strlen(s);
-  char *res = (char *)arena_alloc(&global_arena, len + 1);
-  if (!res)
+// Globals in the order they were first bound, found through an open
+// addressing table over the hashes of their names. Every name that reaches
+// the environment is interned, so names compare by pointer. Entries never
+// move in the order, and the version of one counts the values it has had,
+// for the call sites that cache what it holds.
+typedef struct {
+  const char *name;
+  KObj *value;
+  uint64_t version;
+} VarEntry;
+
+static VarEntry *globals;
+static size_t global_count, global_cap;
+static uint32_t *global_index; // entry + 1, 0 when empty
+static size_t global_slots;
+
+static void global_rehash(size_t slots) {
+  uint32_t *index = (uint32_t *)calloc(slots, sizeof(uint32_t));
+  if (!index)
+    oom();
+  for (size_t i = 0; i < global_count; i++) {
+    size_t p = (size_t)sym_hash(globals[i].name) & (slots - 1);
+    while (index[p])
+      p = (p + 1) & (slots - 1);
+    index[p] = (uint32_t)i + 1;
+  }
+  free(global_index);
+  global_index = index;
+  global_slots = slots;
+}
+
+static VarEntry *global_entry(const char *name) {
+  if (!global_slots)
     return NULL;
-  memcpy(res, s, len + 1);
-  return res;
+  size_t mask = global_slots - 1;
+  for (size_t p = (size_t)sym_hash(name) & mask; global_index[p];
+       p = (p + 1) & mask) {
+    VarEntry *e = &globals[global_index[p] - 1];
+    if (e->name == name)
+      return e;
+  }
+  return NULL;
 }
 
+static VarEntry *global_add(const char *name) {
+  if (global_count == global_cap) {
+    global_cap = global_cap ? global_cap * 2 : 64;
+    globals = (VarEntry *)realloc(globals, global_cap * sizeof(VarEntry));
+    if (!globals)
+      oom();
+  }
+  VarEntry *e = &globals[global_count++];
+  e->name = name;
+  e->value = NULL;
+  e->version = 0;
+  if (2 * global_count > global_slots) {
+    global_rehash(global_slots ? global_slots * 2 : 128);
+  } else {
+    size_t mask = global_slots - 1;
+    size_t p = (size_t)sym_hash(name) & mask;
+    while (global_index[p])
+      p = (p + 1) & mask;
+    global_index[p] = (uint32_t)global_count;
+  }
+  return e;
+}
+
+#define VM_BLOCK 65536
+
+// Values being worked on by every chunk that is running; a chunk's frame
+// starts where its caller's top was when it made the call. The stack grows
+// by whole blocks and a frame never straddles two, so pointers into it stay
+// valid while deeper calls go on in later blocks.
+typedef struct StackBlock {
+  struct StackBlock *next;
+  size_t size;
+  KObj *items[];
+} StackBlock;
+
 typedef struct {
-  char *name;
-  KObj *value;
-} VarEntry;
+  StackBlock *block;
+  KObj **sp;
+} StackMark;
+
+static StackBlock *vm_block;
+static KObj **vm_sp, **vm_end;
 
+static void vm_enter(StackBlock *block, KObj **sp) {
+  vm_block = block;
+  vm_sp = sp;
+  vm_end = block->items + block->size;
+}
+
+// Makes room for n values above the top, moving on to the next block when
+// this one is short. Returns where to come back to once they are popped.
+static StackMark vm_reserve(size_t n) {
+  if (!vm_block) {
+    StackBlock *b =
+        (StackBlock *)malloc(sizeof(StackBlock) + VM_BLOCK * sizeof(KObj *));
+    if (!b)
+      oom();
+    b->next = NULL;
+    b->size = VM_BLOCK;
+    vm_enter(b, b->items);
+  }
+  StackMark mark = {vm_block, vm_sp};
+  if ((size_t)(vm_end - vm_sp) >= n)
+    return mark;
+  StackBlock *b = vm_block->next;
+  if (!b || b->size < n) {
+    size_t size = n > VM_BLOCK ? n : VM_BLOCK;
+    b = (StackBlock *)malloc(sizeof(StackBlock) + size * sizeof(KObj *));
+    if (!b)
+      oom();
+    b->next = vm_block->next;
+    b->size = size;
+    vm_block->next = b;
+  }
+  vm_enter(b, b->items);
+  return mark;
+}
+
+// A running lambda's locals, in the slots its chunk gave them. An empty
+// slot is a local that has not been assigned yet. A lambda called from
+// bytecode runs in its caller's loop in run(), and its frame keeps where
+// that caller resumes.
 typedef struct {
-  VarEntry entries[256];
-  size_t count;
-} EnvFrame;
+  const Chunk *chunk;
+  KObj **slots;
+  KLambda *lam;
+  KObj *fn;       // held while it runs in its caller's loop
+  StackMark mark; // the top before the slots were reserved
+  const Chunk *ret_chunk;
+  KObj **ret_slots, **ret_base, **ret_sp;
+  size_t ret_pc, ret_at;
+} Frame;
+
+// Frames live on the heap, but a lambda called from C, by a builtin such as
+// each or over, still recurses through run() on the C stack; these keep a
+// runaway recursion to an error well before either gives out.
+#define MAX_DEPTH 1000000
+#define MAX_NESTED 10000
 
-static EnvFrame env_stack[256];
+static Frame *frames; // frames[0] is the global scope
+static size_t frame_cap;
 static size_t env_top = 0;
+static size_t nested; // calls to call_lambda under way
+
+// How many running frames have a local of each name, by symbol id, so that
+// looking up any other name goes straight to the globals however deep the
+// recursion is.
+static uint32_t *shadows;
+static size_t shadow_cap;
 
-static void env_push() {
-  env_top++;
-  env_stack[env_top].count = 0;
+static void shadow(const Chunk *chunk, int by) {
+  for (size_t i = 0; i < chunk->slot_count; i++) {
+    uint32_t id = sym_id(chunk->names[i]);
+    if (id >= shadow_cap) {
+      size_t cap = shadow_cap ? shadow_cap : 64;
+      while (cap <= id)
+        cap *= 2;
+      shadows = (uint32_t *)realloc(shadows, cap * sizeof(uint32_t));
+      if (!shadows)
+        oom();
+      memset(shadows + shadow_cap, 0, (cap - shadow_cap) * sizeof(uint32_t));
+      shadow_cap = cap;
+    }
+    shadows[id] += by;
+  }
 }
 
-static void env_pop() {
-  EnvFrame *frame = &env_stack[env_top];
-  for (size_t i = 0; i < frame->count; i++) {
-    release_object(frame->entries[i].value);
+static KObj **frame_ref(Frame *frame, const char *name) {
+  const Chunk *chunk = frame->chunk;
+  for (size_t i = chunk->slot_count; i-- > 0;) {
+    if (chunk->names[i] == name)
+      return &frame->slots[i];
   }
-  env_top--;
+  return NULL;
 }
 
-static KObj *env_get(const char *name) {
-  for (size_t f = env_top + 1; f-- > 0;) {
-    EnvFrame *frame = &env_stack[f];
-    for (size_t i = 0; i < frame->count; i++) {
-      if (strcmp(frame->entries[i].name, name) == 0) {
-        retain_object(frame->entries[i].value);
-        return frame->entries[i].value;
+// Where the innermost binding of name lives: the locals of each running
+// lambda from the innermost out, then the globals. NULL when unbound.
+static KObj **env_ref(const char *name) {
+  uint32_t id = sym_id(name);
+  for (size_t f = id < shadow_cap && shadows[id] ? env_top : 0; f > 0; f--) {
+    KObj **ref = frame_ref(&frames[f], name);
+    if (ref && *ref)
+      return ref;
+  }
+  VarEntry *e = global_entry(name);
+  return e && e->value ? &e->value : NULL;
+}
+
+// A name bound to nothing that prefixes dotted globals reads as a dict of
+// its members, keyed by the next part of their names: .cfg holds .cfg.limit
+// under `limit, and .cfg.db.host inside the dict under `db. NULL when no
+// global lives under name.
+static KObj *namespace_dict(const char *name) {
+  size_t len = strlen(name);
+  KObj *keys = NULL, *values = NULL;
+  for (size_t i = 0; i < global_count; i++) {
+    const char *full = globals[i].name;
+    if (!globals[i].value || strncmp(full, name, len) != 0 ||
+        full[len] != '.')
+      continue;
+    const char *part = full + len + 1;
+    const char *dot = strchr(part, '.');
+    size_t part_len = dot ? (size_t)(dot - part) : strlen(part);
+    const char *key = sym_intern(part, part_len);
+    bool seen = false;
+    for (size_t j = 0; keys && j < keys->as.vector->length && !seen; j++) {
+      KObj *k = vector_get(keys, j);
+      seen = k->as.symbol_value == key;
+      release_object(k);
+    }
+    if (seen)
+      continue;
+    KObj *value;
+    if (dot) {
+      const char *member = sym_intern(full, (size_t)(dot - full));
+      VarEntry *e = global_entry(member);
+      if (e && e->value) {
+        value = e->value;
+        retain_object(value);
+      } else {
+        value = namespace_dict(member);
       }
+    } else {
+      value = globals[i].value;
+      retain_object(value);
+    }
+    if (!keys) {
+      keys = create_vec(0);
+      values = create_vec(0);
     }
+    KObj *k = create_symbol(key);
+    vector_append(keys, k);
+    vector_append(values, value);
+    release_object(k);
+    release_object(value);
   }
-  printf("^var\n");
-  return create_nil();
+  if (!keys)
+    return NULL;
+  KObj *dict = create_dict(keys, values);
+  release_object(keys);
+  release_object(values);
+  return dict;
+}
+
+static KObj *env_get(const char *name) {
+  KObj **ref = env_ref(name);
+  if (!ref) {
+    KObj *ns = namespace_dict(name);
+    if (ns)
+      return ns;
+    printf("^var\n");
+    return create_nil();
+  }
+  retain_object(*ref);
+  return *ref;
 }
 
 static void env_set(const char *name, KObj *value) {
-  EnvFrame *frame = &env_stack[env_top];
-  for (size_t i = 0; i < frame->count; i++) {
-    if (strcmp(frame->entries[i].name, name) == 0) {
-      release_object(frame->entries[i].value);
-      frame->entries[i].value = value;
+  KObj **ref = env_top > 0 ? frame_ref(&frames[env_top], name) : NULL;
+  if (!ref) {
+    VarEntry *e = global_entry(name);
+    if (!e)
+      e = global_add(name);
+    e->version++;
+    ref = &e->value;
+  }
+  retain_object(value);
+  release_object(*ref);
+  *ref = value;
+}
+
+// Hand the current scope's reference to name over to the caller, leaving
+// the slot empty until it is set again. NULL if name is not bound here.
+static KObj *env_take(const char *name) {
+  KObj **ref = NULL;
+  if (env_top > 0) {
+    ref = frame_ref(&frames[env_top], name);
+  } else {
+    VarEntry *e = global_entry(name);
+    if (e)
+      e->version++;
+    ref = e ? &e->value : NULL;
+  }
+  if (!ref)
+    return NULL;
+  KObj *value = *ref;
+  *ref = NULL;
+  return value;
+}
+
+// Like env_get, but a vector or dict that is also referenced from elsewhere
+// is first replaced by a private copy, so the caller may update it in place.
+// A dict copy shares its keys and values until dict_set writes to them.
+static KObj *get_unique(KObj **ref) {
+  KObj *value = *ref;
+  if (value->type == VECTOR && value->ref_count > 1) {
+    *ref = vector_copy(value);
+    release_object(value);
+  } else if (value->type == DICT && value->ref_count > 1) {
+    *ref = create_dict(value->as.dict->keys, value->as.dict->values);
+    release_object(value);
+  }
+  retain_object(*ref);
+  return *ref;
+}
+
+static KObj *env_get_unique(const char *name) {
+  KObj **ref = env_ref(name);
+  if (!ref) {
+    printf("^var\n");
+    return create_nil();
+  }
+  return get_unique(ref);
+}
+
+// Accessors for a var operand of chunk, whose frame's locals are slots.
+// A local that is still empty reads through to the enclosing scopes.
+static const char *var_name(const Chunk *chunk, uint32_t var) {
+  if (var & VAR_LOCAL)
+    return chunk->names[var & ~VAR_LOCAL];
+  return (const char *)chunk->pool[var];
+}
+
+static inline KObj *var_get(const Chunk *chunk, KObj **slots, uint32_t var) {
+  if (var & VAR_LOCAL) {
+    KObj *value = slots[var & ~VAR_LOCAL];
+    if (value) {
       retain_object(value);
-      return;
+      return value;
     }
   }
-  frame->entries[frame->count].name = k_strdup_local(name);
-  frame->entries[frame->count].value = value;
+  return env_get(var_name(chunk, var));
+}
+
+static void var_set(const Chunk *chunk, KObj **slots, uint32_t var,
+                    KObj *value) {
+  if (!(var & VAR_LOCAL)) {
+    env_set(var_name(chunk, var), value);
+    return;
+  }
+  KObj **ref = &slots[var & ~VAR_LOCAL];
   retain_object(value);
-  frame->count++;
+  release_object(*ref);
+  *ref = value;
+}
+
+static KObj *var_take(const Chunk *chunk, KObj **slots, uint32_t var) {
+  if (!(var & VAR_LOCAL))
+    return env_take(var_name(chunk, var));
+  KObj *value = slots[var & ~VAR_LOCAL];
+  slots[var & ~VAR_LOCAL] = NULL;
+  return value;
+}
+
+static KObj *var_get_unique(const Chunk *chunk, KObj **slots, uint32_t var) {
+  if ((var & VAR_LOCAL) && slots[var & ~VAR_LOCAL])
+    return get_unique(&slots[var & ~VAR_LOCAL]);
+  return env_get_unique(var_name(chunk, var));
+}
+
+// k_fused over node with the values of its n variables, read without
+// taking references or reporting unbound ones. NULL when a variable is
+// unbound or k_fused declines, for the plain code to deal with.
+static KObj *fused(const Chunk *chunk, KObj **slots, ASTNode *node,
+                   const uint32_t *vars, uint32_t n) {
+  KObj *values[FUSED_MAX];
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t var = vars[i];
+    KObj **ref = (var & VAR_LOCAL) && slots[var & ~VAR_LOCAL]
+                     ? &slots[var & ~VAR_LOCAL]
+                     : env_ref(var_name(chunk, var));
+    if (!ref)
+      return NULL;
+    values[i] = *ref;
+  }
+  return k_fused(node, values);
 }
 
 void env_dump() {
-  for (size_t f = 0; f <= env_top; f++) {
-    EnvFrame *frame = &env_stack[f];
-    for (size_t i = 0; i < frame->count; i++) {
-      printf("%s: ", frame->entries[i].name);
-      print(frame->entries[i].value);
-    }
+  for (size_t i = 0; i < global_count; i++) {
+    if (!globals[i].value)
+      continue;
+    printf("%s: ", globals[i].name);
+    print(globals[i].value);
+  }
+}
+
+void env_footprint() {
+  for (size_t i = 0; i < global_count; i++) {
+    if (globals[i].value)
+      printf("%s: %zu\n", globals[i].name, obj_footprint(globals[i].value));
   }
 }
 
@@ -92,8 +418,13 @@ static KObj *eval_literal(KObj *obj) {
   switch (obj->type) {
   case VECTOR: {
     KObj *res = create_vec(obj->as.vector->length);
+    if (obj->as.vector->elem != NIL) {
+      for (size_t i = 0; i < obj->as.vector->length; i++)
+        vector_append_from(res, obj, i);
+      return res;
+    }
     for (size_t i = 0; i < obj->as.vector->length; i++) {
-      KObj *item = eval_literal(&obj->as.vector->items[i]);
+      KObj *item = eval_literal(obj->as.vector->items[i]);
       if (item->type == NIL) {
         release_object(item);
         release_object(res);
@@ -110,592 +441,1033 @@ static KObj *eval_literal(KObj *obj) {
   }
 }
 
-KObj *evaluate(ASTNode *node) {
-  if (node == NULL) {
-    return create_nil();
+// Evaluate a self update with the old value moved out of the frame, so
+// that when nothing else refers to it the verb can write the result over
+// it instead of allocating a new vector. arg is the right operand of a
+// binary update, already evaluated, and is consumed.
+static KObj *eval_self_update(const Chunk *chunk, KObj **slots, uint32_t var,
+                              ASTNode *expr, KObj *arg) {
+  KObj *old = var_take(chunk, slots, var);
+  bool taken = old != NULL;
+  if (!taken) {
+    old = var_get(chunk, slots, var);
+    if (old->type == NIL) {
+      release_object(arg);
+      return old;
+    }
   }
+  KObj *result;
+  if (expr->type == AST_BINARY)
+    result = k_binary_owned(get_op_desc(expr->as.binary.op.type)->binary, old,
+                            arg);
+  else
+    result = k_unary_owned(get_op_desc(expr->as.unary.op.type)->unary, old);
+  release_object(arg);
+  if (result->type != NIL)
+    var_set(chunk, slots, var, result);
+  else if (taken)
+    var_set(chunk, slots, var, old);
+  release_object(old);
+  return result;
+}
 
-  switch (node->type) {
-  case AST_LITERAL: {
-    return eval_literal(node->as.literal.value);
-  }
-  case AST_VAR: {
-    return env_get(node->as.var.name);
-  }
-  case AST_UNARY: {
-    KObj *val = evaluate(node->as.unary.child);
-    if (val->type == NIL) {
-      return val;
+// name[i]:v once the target, index and value are evaluated: one or more
+// positions of a vector, or keys of a dict. Consumes all three.
+static KObj *amend(KObj *vec, KObj *idx_obj, KObj *right_val) {
+  if (vec->type == DICT) {
+    bool many = idx_obj->type == VECTOR;
+    bool val_is_vec = right_val->type == VECTOR;
+    size_t key_count = many ? idx_obj->as.vector->length : 1;
+    size_t val_count = val_is_vec ? right_val->as.vector->length : 1;
+    if (many && val_count != key_count) {
+      printf("^length\n");
+      release_object(vec);
+      release_object(idx_obj);
+      release_object(right_val);
+      return create_nil();
     }
-    KObj *result_obj = NULL;
-    const OpDesc *d = get_op_desc(node->as.unary.op.type);
-    if (d && d->unary) {
-      result_obj = d->unary(val);
-    } else {
-      printf("^nyi\n");
-      result_obj = create_nil();
+    for (size_t i = 0; many && i < key_count; i++) {
+      KObj *key = vector_get(idx_obj, i);
+      KType t = key->type;
+      release_object(key);
+      if (t == VECTOR || t == DICT || t == VERB || t == ADVERB ||
+          t == LAMBDA) {
+        printf("^domain\n");
+        release_object(vec);
+        release_object(idx_obj);
+        release_object(right_val);
+        return create_nil();
+      }
     }
-    release_object(val);
-    return result_obj;
+    for (size_t i = 0; i < key_count; i++) {
+      KObj *key = many ? vector_get(idx_obj, i) : idx_obj;
+      KObj *new_val =
+          many && val_is_vec ? vector_get(right_val, i) : right_val;
+      dict_set(vec, key, new_val);
+      if (many)
+        release_object(key);
+      if (many && val_is_vec)
+        release_object(new_val);
+    }
+    release_object(vec);
+    release_object(idx_obj);
+    return right_val;
   }
-
-  case AST_BINARY: {
-    if (node->as.binary.op.type == COLON) {
-      if (node->as.binary.left->type == AST_VAR) {
-        const char *name = node->as.binary.left->as.var.name;
-        KObj *right_val = evaluate(node->as.binary.right);
-        if (right_val->type == NIL) {
-          return right_val;
-        }
-        env_set(name, right_val);
-        return right_val;
-      }
-      if (node->as.binary.left->type == AST_CALL) {
-        ASTNode *call = node->as.binary.left;
-        if (call->as.call.callee->type == AST_VAR &&
-            call->as.call.arg_count == 1) {
-          const char *name = call->as.call.callee->as.var.name;
-          KObj *vec = env_get(name);
-          if (vec->type != VECTOR) {
-            if (vec->type != NIL)
-              printf("^type\n");
-            release_object(vec);
-            return create_nil();
-          }
-          KObj *idx_obj = evaluate(call->as.call.args[0]);
-          if (idx_obj->type == NIL) {
-            release_object(vec);
-            return idx_obj;
-          }
-          KObj *right_val = evaluate(node->as.binary.right);
-          if (right_val->type == NIL) {
-            release_object(vec);
-            release_object(idx_obj);
-            return right_val;
-          }
-          if (idx_obj->type == INT) {
-            size_t vec_len = vec->as.vector->length;
-            int64_t id = idx_obj->as.int_value;
-            if (id < 0 || (size_t)id >= vec_len) {
-              printf("^length\n");
-              release_object(vec);
-              release_object(idx_obj);
-              release_object(right_val);
-              return create_nil();
-            }
-            vector_set(vec, (size_t)id, right_val);
-            release_object(vec);
-            release_object(idx_obj);
-            return right_val;
-          } else if (idx_obj->type == VECTOR) {
-            size_t idx_count = idx_obj->as.vector->length;
-            int64_t *idxs = (int64_t *)malloc(sizeof(int64_t) * idx_count);
-            for (size_t i = 0; i < idx_count; i++) {
-              KObj *it = &idx_obj->as.vector->items[i];
-              if (it->type != INT) {
-                printf("^type\n");
-                free(idxs);
-                release_object(vec);
-                release_object(idx_obj);
-                release_object(right_val);
-                return create_nil();
-              }
-              idxs[i] = it->as.int_value;
-            }
-            bool val_is_vec = right_val->type == VECTOR;
-            size_t val_count = val_is_vec ? right_val->as.vector->length : 1;
-            if (val_count != idx_count) {
-              printf("^length\n");
-              free(idxs);
-              release_object(vec);
-              release_object(idx_obj);
-              release_object(right_val);
-              return create_nil();
-            }
-            size_t vec_len = vec->as.vector->length;
-            for (size_t i = 0; i < idx_count; i++) {
-              if (idxs[i] < 0 || (size_t)idxs[i] >= vec_len) {
-                printf("^length\n");
-                free(idxs);
-                release_object(vec);
-                release_object(idx_obj);
-                release_object(right_val);
-                return create_nil();
-              }
-            }
-            for (size_t i = 0; i < idx_count; i++) {
-              size_t pos = (size_t)idxs[i];
-              KObj *new_val =
-                  val_is_vec ? &right_val->as.vector->items[i] : right_val;
-              vector_set(vec, pos, new_val);
-            }
-            free(idxs);
-            release_object(vec);
-            release_object(idx_obj);
-            return right_val;
-          } else {
-            printf("^type\n");
-            release_object(vec);
-            release_object(idx_obj);
-            release_object(right_val);
-            return create_nil();
-          }
-        }
-        if (call->as.call.callee->type == AST_VAR &&
-            call->as.call.arg_count >= 2) {
-          const char *name = call->as.call.callee->as.var.name;
-          KObj *vec = env_get(name);
-          if (vec->type != VECTOR) {
-            if (vec->type != NIL)
-              printf("^type\n");
-            release_object(vec);
-            return create_nil();
-          }
-          size_t argc = call->as.call.arg_count;
-          KObj **idxobjs = (KObj **)malloc(sizeof(KObj *) * argc);
-          for (size_t i = 0; i < argc; i++) {
-            idxobjs[i] = evaluate(call->as.call.args[i]);
-            if (idxobjs[i]->type == NIL) {
-              for (size_t j = 0; j <= i; j++)
-                release_object(idxobjs[j]);
-              free(idxobjs);
-              release_object(vec);
-              return create_nil();
-            }
-            if (idxobjs[i]->type != INT) {
-              printf("^type\n");
-              for (size_t j = 0; j <= i; j++)
-                release_object(idxobjs[j]);
-              free(idxobjs);
-              release_object(vec);
-              return create_nil();
-            }
-          }
-          KObj *container = vec;
-          for (size_t i = 0; i + 1 < argc; i++) {
-            if (container->type != VECTOR) {
-              printf("^type\n");
-              for (size_t j = 0; j < argc; j++)
-                release_object(idxobjs[j]);
-              free(idxobjs);
-              release_object(vec);
-              return create_nil();
-            }
-            int64_t id = idxobjs[i]->as.int_value;
-            size_t len = container->as.vector->length;
-            if (id < 0 || (size_t)id >= len) {
-              printf("^length\n");
-              for (size_t j = 0; j < argc; j++)
-                release_object(idxobjs[j]);
-              free(idxobjs);
-              release_object(vec);
-              return create_nil();
-            }
-            KObj *child = &container->as.vector->items[id];
-            container = child;
-          }
-          if (container->type != VECTOR) {
-            printf("^type\n");
-            for (size_t j = 0; j < argc; j++)
-              release_object(idxobjs[j]);
-            free(idxobjs);
-            release_object(vec);
-            return create_nil();
-          }
-          int64_t last = idxobjs[argc - 1]->as.int_value;
-          size_t clen = container->as.vector->length;
-          if (last < 0 || (size_t)last >= clen) {
-            printf("^length\n");
-            for (size_t j = 0; j < argc; j++)
-              release_object(idxobjs[j]);
-            free(idxobjs);
-            release_object(vec);
-            return create_nil();
-          }
-          KObj *right_val = evaluate(node->as.binary.right);
-          if (right_val->type == NIL) {
-            for (size_t j = 0; j < argc; j++)
-              release_object(idxobjs[j]);
-            free(idxobjs);
-            release_object(vec);
-            return right_val;
-          }
-          vector_set(container, (size_t)last, right_val);
-          for (size_t j = 0; j < argc; j++)
-            release_object(idxobjs[j]);
-          free(idxobjs);
-          release_object(vec);
-          return right_val;
-        }
-      }
-      printf("^assign\n");
+  if (idx_obj->type == INT) {
+    size_t vec_len = vec->as.vector->length;
+    int64_t id = idx_obj->as.int_value;
+    if (id < 0 || (size_t)id >= vec_len) {
+      printf("^length\n");
+      release_object(vec);
+      release_object(idx_obj);
+      release_object(right_val);
       return create_nil();
     }
-    KObj *left_val = evaluate(node->as.binary.left);
-    if (left_val->type == NIL) {
-      return left_val;
+    vector_set(vec, (size_t)id, right_val);
+    release_object(vec);
+    release_object(idx_obj);
+    return right_val;
+  } else if (idx_obj->type == VECTOR) {
+    size_t idx_count = idx_obj->as.vector->length;
+    ArenaMark scratch = arena_mark(&global_arena);
+    int64_t *idxs = (int64_t *)arena_alloc(&global_arena,
+                                           sizeof(int64_t) * idx_count);
+    for (size_t i = 0; i < idx_count; i++) {
+      KObj *it = vector_get(idx_obj, i);
+      if (it->type != INT) {
+        printf("^type\n");
+        release_object(it);
+        arena_release(&global_arena, scratch);
+        release_object(vec);
+        release_object(idx_obj);
+        release_object(right_val);
+        return create_nil();
+      }
+      idxs[i] = it->as.int_value;
+      release_object(it);
     }
-    KObj *right_val = evaluate(node->as.binary.right);
-    if (right_val->type == NIL) {
-      release_object(left_val);
-      return right_val;
+    bool val_is_vec = right_val->type == VECTOR;
+    size_t val_count = val_is_vec ? right_val->as.vector->length : 1;
+    if (val_count != idx_count) {
+      printf("^length\n");
+      arena_release(&global_arena, scratch);
+      release_object(vec);
+      release_object(idx_obj);
+      release_object(right_val);
+      return create_nil();
     }
-    KObj *result_obj = NULL;
-    const OpDesc *d2 = get_op_desc(node->as.binary.op.type);
-    if (d2 && d2->binary) {
-      result_obj = d2->binary(left_val, right_val);
-    } else {
-      printf("^nyi\n");
-      result_obj = create_nil();
+    size_t vec_len = vec->as.vector->length;
+    for (size_t i = 0; i < idx_count; i++) {
+      if (idxs[i] < 0 || (size_t)idxs[i] >= vec_len) {
+        printf("^length\n");
+        arena_release(&global_arena, scratch);
+        release_object(vec);
+        release_object(idx_obj);
+        release_object(right_val);
+        return create_nil();
+      }
+    }
+    for (size_t i = 0; i < idx_count; i++) {
+      size_t pos = (size_t)idxs[i];
+      KObj *new_val =
+          val_is_vec ? vector_get(right_val, i) : right_val;
+      vector_set(vec, pos, new_val);
+      if (val_is_vec)
+        release_object(new_val);
     }
-    release_object(left_val);
+    arena_release(&global_arena, scratch);
+    release_object(vec);
+    release_object(idx_obj);
+    return right_val;
+  } else {
+    printf("^type\n");
+    release_object(vec);
+    release_object(idx_obj);
     release_object(right_val);
-    return result_obj;
-  }
-  case AST_CONDITIONAL: {
-    KObj *condition_result = evaluate(node->as.conditional.condition);
-    if (condition_result->type == NIL) {
-      return condition_result;
-    }
-    bool is_true = false;
-    if (condition_result->type == INT) {
-      is_true = (condition_result->as.int_value != 0);
-    } else if (condition_result->type == FLOAT) {
-      is_true = (condition_result->as.float_value != 0.0);
-    } else {
-      is_true = true;
+    return create_nil();
+  }
+}
+
+// Follows name[i;j;...] down to the vector the last index writes into,
+// detaching shared levels on the way, and checks that index. Consumes vec
+// and every index but the last; on error releases that one too and
+// returns nil.
+static KObj *amend_walk(KObj *vec, KObj **idxobjs, size_t argc) {
+  KObj *container = vec;
+  for (size_t i = 0; i + 1 < argc; i++) {
+    if (container->type != VECTOR) {
+      printf("^type\n");
+      for (size_t j = 0; j < argc; j++)
+        release_object(idxobjs[j]);
+      release_object(container);
+      return create_nil();
+    }
+    int64_t id = idxobjs[i]->as.int_value;
+    size_t len = container->as.vector->length;
+    if (id < 0 || (size_t)id >= len) {
+      printf("^length\n");
+      for (size_t j = 0; j < argc; j++)
+        release_object(idxobjs[j]);
+      release_object(container);
+      return create_nil();
+    }
+    KObj *child = vector_get(container, (size_t)id);
+    if (child->type == VECTOR && child->ref_count > 2) {
+      // shared beyond this slot: detach before writing into it
+      KObj *copy = vector_copy(child);
+      vector_set(container, (size_t)id, copy);
+      release_object(child);
+      child = copy;
     }
-    release_object(condition_result);
-    if (is_true) {
-      return evaluate(node->as.conditional.then_branch);
+    release_object(container);
+    container = child;
+  }
+  if (container->type != VECTOR) {
+    printf("^type\n");
+    for (size_t j = 0; j < argc; j++)
+      release_object(idxobjs[j]);
+    release_object(container);
+    return create_nil();
+  }
+  int64_t last = idxobjs[argc - 1]->as.int_value;
+  size_t clen = container->as.vector->length;
+  if (last < 0 || (size_t)last >= clen) {
+    printf("^length\n");
+    for (size_t j = 0; j < argc; j++)
+      release_object(idxobjs[j]);
+    release_object(container);
+    return create_nil();
+  }
+  for (size_t j = 0; j + 1 < argc; j++)
+    release_object(idxobjs[j]);
+  return container;
+}
+
+// Applies the adverb op with child to evaluated args; args are borrowed.
+static KObj *apply_adverb(TokenType op, KObj *child, KObj **args,
+                          size_t argn) {
+  KObj *result = NULL;
+  // f/ walks its list with vector_get; every other adverb reads storage
+  bool over = op == SLASH &&
+              (child->type == VERB || child->type == LAMBDA ||
+               child->type == PROJ);
+  for (size_t i = 0; i < argn; i++) {
+    if (!(over && i == argn - 1))
+      vector_force(args[i]);
+  }
+  if (op == SLASH) {
+    if (child->type == VERB || child->type == LAMBDA ||
+        child->type == PROJ) {
+      if (argn == 1) {
+        result = k_over(child, args[0], NULL);
+      } else if (argn == 2) {
+        result = k_over(child, args[1], args[0]);
+      } else {
+        printf("^rank (over)\n");
+        result = create_nil();
+      }
+    } else if (child->type == INT) {
+      if (argn != 1) {
+        printf("^rank (decode)\n");
+        result = create_nil();
+      } else {
+        result = k_decode(child, args[0]);
+      }
     } else {
-      return evaluate(node->as.conditional.else_branch);
-    }
-  }
-  case AST_ADVERB: {
-    KObj *child_obj = evaluate(node->as.adverb.child);
-    if (child_obj->type == NIL) {
-      return child_obj;
-    }
-    KObj *adv = create_object(ADVERB);
-    adv->as.adverb = (KAdverb *)arena_alloc(&global_arena, sizeof(KAdverb));
-    adv->as.adverb->op = node->as.adverb.op;
-    adv->as.adverb->child = child_obj;
-    return adv;
-  }
-  case AST_CALL: {
-    KObj *fn = evaluate(node->as.call.callee);
-    if (fn->type == NIL) {
-      return fn;
-    }
-    size_t argn = node->as.call.arg_count;
-    KObj **args = (KObj **)malloc(sizeof(KObj *) * argn);
-    size_t assign_idx = (size_t)-1;
-    if (fn->type == ADVERB && argn >= 2) {
-      for (size_t i = 0; i < argn; i++) {
-        ASTNode *a = node->as.call.args[i];
-        if (a && a->type == AST_BINARY && a->as.binary.op.type == COLON &&
-            a->as.binary.left && a->as.binary.left->type == AST_VAR) {
-          assign_idx = i;
-          break;
-        }
+      if (argn != 1) {
+        printf("^rank (join)\n");
+        result = create_nil();
+      } else {
+        result = k_join(child, args[0]);
       }
     }
-    if (assign_idx != (size_t)-1) {
-      args[assign_idx] = evaluate(node->as.call.args[assign_idx]);
-      if (args[assign_idx]->type == NIL) {
-        release_object(fn);
-        free(args);
-        return create_nil();
+  } else if (op == BACKSLASH) {
+    if (child->type == VERB || child->type == LAMBDA ||
+        child->type == PROJ) {
+      if (argn == 1) {
+        result = k_scan(child, args[0], NULL);
+      } else if (argn == 2) {
+        result = k_scan(child, args[1], args[0]);
+      } else {
+        printf("^rank (scan)\n");
+        result = create_nil();
       }
-      for (size_t i = 0; i < argn; i++) {
-        if (i == assign_idx)
-          continue;
-        args[i] = evaluate(node->as.call.args[i]);
-        if (args[i]->type == NIL) {
-          for (size_t j = 0; j < argn; j++) {
-            if (j == i)
-              break;
-            if (j == assign_idx)
-              continue;
-            release_object(args[j]);
-          }
-          release_object(args[assign_idx]);
-          release_object(fn);
-          free(args);
-          return create_nil();
-        }
+    } else if (child->type == INT) {
+      if (argn != 1) {
+        printf("^rank (encode)\n");
+        result = create_nil();
+      } else {
+        result = k_encode(child, args[0]);
       }
     } else {
-      for (size_t i = 0; i < argn; i++) {
-        args[i] = evaluate(node->as.call.args[i]);
-        if (args[i]->type == NIL) {
-          for (size_t j = 0; j <= i; j++)
-            release_object(args[j]);
-          release_object(fn);
-          free(args);
-          return create_nil();
-        }
+      if (argn != 1) {
+        printf("^rank (split)\n");
+        result = create_nil();
+      } else {
+        result = k_split(child, args[0]);
       }
     }
-    if (fn->type == ADVERB) {
-      KObj *child = fn->as.adverb->child;
-      KObj *result = NULL;
-      if (fn->as.adverb->op.type == SLASH) {
-        if (child->type == VERB || child->type == LAMBDA ||
-            child->type == PROJ) {
-          if (argn == 1) {
-            result = k_over(child, args[0], NULL);
-          } else if (argn == 2) {
-            result = k_over(child, args[1], args[0]);
+  } else if (op == TICK) {
+    if (child->type == VERB || child->type == LAMBDA ||
+        child->type == PROJ) {
+      result = k_each_n(child, args, argn);
+    } else {
+      printf("^type (each)\n");
+      result = create_nil();
+    }
+  } else if (op == SLASH_COLON) {
+    if (!(child->type == VERB || child->type == LAMBDA ||
+          child->type == PROJ)) {
+      printf("^type (eachright)\n");
+      result = create_nil();
+    } else if (argn != 2) {
+      printf("^rank (eachright)\n");
+      result = create_nil();
+    } else {
+      KObj *left = args[0];
+      KObj *right = args[1];
+      if (right->type == VECTOR) {
+        size_t len = right->as.vector->length;
+        KObj *res = create_vec(len);
+        for (size_t i = 0; i < len; i++) {
+          KObj *elem = vector_get(right, i);
+          KObj *val = NULL;
+          if (child->type == VERB && child->as.verb.binary) {
+            val = child->as.verb.binary(left, elem);
           } else {
-            printf("^rank (over)\n");
-            result = create_nil();
+            KObj *call_args[2] = {left, elem};
+            val = call_n(child, call_args, 2);
           }
-        } else if (child->type == INT) {
-          if (argn != 1) {
-            printf("^rank (decode)\n");
-            result = create_nil();
-          } else {
-            result = k_decode(child, args[0]);
+          release_object(elem);
+          if (val->type == NIL) {
+            release_object(res);
+            return val;
           }
+          vector_append(res, val);
+          release_object(val);
+        }
+        result = res;
+      } else {
+        if (child->type == VERB && child->as.verb.binary) {
+          result = child->as.verb.binary(left, right);
         } else {
-          if (argn != 1) {
-            printf("^rank (join)\n");
-            result = create_nil();
-          } else {
-            result = k_join(child, args[0]);
-          }
+          KObj *call_args[2] = {left, right};
+          result = call_n(child, call_args, 2);
         }
-      } else if (fn->as.adverb->op.type == BACKSLASH) {
-        if (child->type == VERB || child->type == LAMBDA ||
-            child->type == PROJ) {
-          if (argn == 1) {
-            result = k_scan(child, args[0], NULL);
-          } else if (argn == 2) {
-            result = k_scan(child, args[1], args[0]);
-          } else {
-            printf("^rank (scan)\n");
-            result = create_nil();
-          }
-        } else if (child->type == INT) {
-          if (argn != 1) {
-            printf("^rank (encode)\n");
-            result = create_nil();
+      }
+    }
+  } else if (op == BACKSLASH_COLON) {
+    if (!(child->type == VERB || child->type == LAMBDA ||
+          child->type == PROJ)) {
+      printf("^type (eachleft)\n");
+      result = create_nil();
+    } else if (argn != 2) {
+      printf("^rank (eachleft)\n");
+      result = create_nil();
+    } else {
+      KObj *left = args[0];
+      KObj *right = args[1];
+      if (left->type == VECTOR) {
+        size_t len = left->as.vector->length;
+        KObj *res = create_vec(len);
+        for (size_t i = 0; i < len; i++) {
+          KObj *elem = vector_get(left, i);
+          KObj *val = NULL;
+          if (child->type == VERB && child->as.verb.binary) {
+            val = child->as.verb.binary(elem, right);
           } else {
-            result = k_encode(child, args[0]);
+            KObj *call_args[2] = {elem, right};
+            val = call_n(child, call_args, 2);
           }
-        } else {
-          if (argn != 1) {
-            printf("^rank (split)\n");
-            result = create_nil();
-          } else {
-            result = k_split(child, args[0]);
+          release_object(elem);
+          if (val->type == NIL) {
+            release_object(res);
+            return val;
           }
+          vector_append(res, val);
+          release_object(val);
         }
-      } else if (fn->as.adverb->op.type == TICK) {
-        if (child->type == VERB || child->type == LAMBDA ||
-            child->type == PROJ) {
-          result = k_each_n(child, args, argn);
+        result = res;
+      } else {
+        if (child->type == VERB && child->as.verb.binary) {
+          result = child->as.verb.binary(left, right);
         } else {
-          printf("^type (each)\n");
-          result = create_nil();
+          KObj *call_args[2] = {left, right};
+          result = call_n(child, call_args, 2);
         }
-      } else if (fn->as.adverb->op.type == SLASH_COLON) {
-        if (!(child->type == VERB || child->type == LAMBDA ||
-              child->type == PROJ)) {
-          printf("^type (eachright)\n");
-          result = create_nil();
-        } else if (argn != 2) {
-          printf("^rank (eachright)\n");
-          result = create_nil();
+      }
+    }
+  } else {
+    printf("^nyi\n");
+    result = create_nil();
+  }
+  return result;
+}
+
+// fn[args] once everything is evaluated: an adverb or function call, or
+// indexing at depth for lists and dicts. Consumes fn and args.
+static KObj *call_value(KObj *fn, KObj **args, size_t argn) {
+  if (fn->type == ADVERB) {
+    KObj *result =
+        apply_adverb(fn->as.adverb->op.type, fn->as.adverb->child, args, argn);
+    for (size_t i = 0; i < argn; i++)
+      release_object(args[i]);
+    release_object(fn);
+    return result;
+  }
+  if (fn->type == LAMBDA || fn->type == VERB || fn->type == PROJ) {
+    KObj *result = call_n(fn, args, argn);
+    for (size_t i = 0; i < argn; i++)
+      release_object(args[i]);
+    release_object(fn);
+    return result;
+  }
+  KObj *current = fn;
+  for (size_t ai = 0; ai < argn; ai++) {
+    KObj *idx = args[ai];
+    KObj *next;
+    if (current->type == DICT) {
+      next = dict_get(current, idx);
+    } else if (current->type != VECTOR) {
+      printf("^type\n");
+      next = create_nil();
+    } else if (idx->type == INT || idx->type == FLOAT) {
+      size_t i = 0;
+      if (idx->type == INT) {
+        if (idx->as.int_value >= 0)
+          i = (size_t)idx->as.int_value;
+        else
+          i = (size_t)-1;
+      } else {
+        if (idx->as.float_value >= 0)
+          i = (size_t)idx->as.float_value;
+        else
+          i = (size_t)-1;
+      }
+      if (i < current->as.vector->length) {
+        next = vector_get(current, i);
+      } else {
+        next = create_int(0);
+      }
+    } else if (idx->type == VECTOR) {
+      size_t idx_len = idx->as.vector->length;
+      KObj *res = create_vec(idx_len);
+      size_t vec_len = current->as.vector->length;
+      bool ok = true;
+      for (size_t j = 0; j < idx_len; j++) {
+        KObj *it = vector_get(idx, j);
+        int64_t id;
+        if (it->type == INT) {
+          id = it->as.int_value;
+        } else if (it->type == FLOAT) {
+          id = (int64_t)it->as.float_value;
         } else {
-          KObj *left = args[0];
-          KObj *right = args[1];
-          if (right->type == VECTOR) {
-            size_t len = right->as.vector->length;
-            KObj *res = create_vec(len);
-            for (size_t i = 0; i < len; i++) {
-              KObj *elem = &right->as.vector->items[i];
-              KObj *val = NULL;
-              if (child->type == VERB && child->as.verb.binary) {
-                val = child->as.verb.binary(left, elem);
-              } else {
-                KObj *call_args[2] = {left, elem};
-                val = call_n(child, call_args, 2);
-              }
-              if (val->type == NIL) {
-                release_object(res);
-                result = val;
-                goto adv_done;
-              }
-              vector_append(res, val);
-              release_object(val);
-            }
-            result = res;
-          } else {
-            if (child->type == VERB && child->as.verb.binary) {
-              result = child->as.verb.binary(left, right);
-            } else {
-              KObj *call_args[2] = {left, right};
-              result = call_n(child, call_args, 2);
-            }
-          }
+          printf("^type\n");
+          release_object(it);
+          ok = false;
+          break;
         }
-      } else if (fn->as.adverb->op.type == BACKSLASH_COLON) {
-        if (!(child->type == VERB || child->type == LAMBDA ||
-              child->type == PROJ)) {
-          printf("^type (eachleft)\n");
-          result = create_nil();
-        } else if (argn != 2) {
-          printf("^rank (eachleft)\n");
-          result = create_nil();
-        } else {
-          KObj *left = args[0];
-          KObj *right = args[1];
-          if (left->type == VECTOR) {
-            size_t len = left->as.vector->length;
-            KObj *res = create_vec(len);
-            for (size_t i = 0; i < len; i++) {
-              KObj *elem = &left->as.vector->items[i];
-              KObj *val = NULL;
-              if (child->type == VERB && child->as.verb.binary) {
-                val = child->as.verb.binary(elem, right);
-              } else {
-                KObj *call_args[2] = {elem, right};
-                val = call_n(child, call_args, 2);
-              }
-              if (val->type == NIL) {
-                release_object(res);
-                result = val;
-                goto adv_done;
-              }
-              vector_append(res, val);
-              release_object(val);
-            }
-            result = res;
-          } else {
-            if (child->type == VERB && child->as.verb.binary) {
-              result = child->as.verb.binary(left, right);
-            } else {
-              KObj *call_args[2] = {left, right};
-              result = call_n(child, call_args, 2);
-            }
-          }
+        release_object(it);
+        if (id < 0 || (size_t)id >= vec_len) {
+          printf("^length\n");
+          ok = false;
+          break;
         }
-      } else {
-        printf("^nyi\n");
-        result = create_nil();
+        vector_append_from(res, current, (size_t)id);
       }
-    adv_done:
-      for (size_t i = 0; i < argn; i++)
-        release_object(args[i]);
-      free(args);
-      release_object(fn);
-      return result;
-    }
-    if (fn->type == LAMBDA || fn->type == VERB || fn->type == PROJ) {
-      KObj *result_obj = call_n(fn, args, argn);
-      for (size_t i = 0; i < argn; i++)
-        release_object(args[i]);
-      free(args);
-      release_object(fn);
-      return result_obj;
-    }
-    KObj *current = fn;
-    for (size_t ai = 0; ai < argn; ai++) {
-      KObj *idx = args[ai];
-      KObj *next;
-      if (current->type != VECTOR) {
-        printf("^type\n");
+      if (!ok) {
+        release_object(res);
         next = create_nil();
-      } else if (idx->type == INT || idx->type == FLOAT) {
-        size_t i = 0;
-        if (idx->type == INT) {
-          if (idx->as.int_value >= 0)
-            i = (size_t)idx->as.int_value;
-          else
-            i = (size_t)-1;
+      } else {
+        next = res;
+      }
+    } else {
+      printf("^type\n");
+      next = create_nil();
+    }
+    release_object(idx);
+    release_object(current);
+    current = next;
+    if (current->type == NIL) {
+      for (size_t j = ai + 1; j < argn; j++)
+        release_object(args[j]);
+      return current;
+    }
+  }
+  return current;
+}
+
+static const Chunk *lambda_code(KLambda *lam) {
+  if (!lam->code)
+    lam->code = compile_lambda(lam);
+  return lam->code;
+}
+
+// Enters a frame for lam with its first n locals bound to args. The slots
+// sit on the value stack just below the body's own operands.
+static void push_frame(KLambda *lam, const Chunk *chunk, KObj **args,
+                       size_t n) {
+  if (env_top + 1 >= frame_cap) {
+    frame_cap = frame_cap ? frame_cap * 2 : 64;
+    frames = (Frame *)realloc(frames, frame_cap * sizeof(Frame));
+    if (!frames)
+      oom();
+  }
+  StackMark mark = vm_reserve(chunk->slot_count + chunk->max_stack);
+  KObj **slots = vm_sp;
+  for (size_t i = 0; i < chunk->slot_count; i++) {
+    slots[i] = i < n ? args[i] : NULL;
+    retain_object(slots[i]);
+  }
+  Frame *f = &frames[++env_top];
+  f->chunk = chunk;
+  f->slots = slots;
+  f->lam = lam;
+  f->fn = NULL;
+  f->mark = mark;
+  vm_sp = slots + chunk->slot_count;
+  shadow(chunk, 1);
+}
+
+// Leaves the top frame, whose body gave result.
+static KObj *pop_frame(KObj *result) {
+  Frame *f = &frames[env_top--];
+  shadow(f->chunk, -1);
+  for (size_t i = 0; i < f->chunk->slot_count; i++)
+    release_object(f->slots[i]);
+  vm_enter(f->mark.block, f->mark.sp);
+  release_object(f->fn);
+  if (!f->lam->has_return) {
+    release_object(result);
+    result = create_nil();
+  }
+  return result;
+}
+
+// Whether a call to lam with argn arguments runs its body rather than
+// making a projection, and how many of them it binds then; see call_n.
+static bool full_call(KLambda *lam, size_t argn, size_t *bind) {
+  size_t arity = lam->param_count > 0 ? (size_t)lam->param_count
+                                      : (size_t)lambda_code(lam)->arity;
+  size_t bound = lam->param_count > 0 ? (size_t)lam->param_count : 3;
+  *bind = argn < bound ? argn : bound;
+  return argn >= arity;
+}
+
+// Whether a frame of chunk has a slot for every local of from, so that
+// reusing the frame of from for it hides nothing a lookup could still see.
+static bool covers(const Chunk *chunk, const Chunk *from) {
+  if (chunk == from)
+    return true;
+  for (size_t i = 0; i < from->slot_count; i++) {
+    size_t j = 0;
+    while (j < chunk->slot_count && chunk->names[j] != from->names[i])
+      j++;
+    if (j == chunk->slot_count)
+      return false;
+  }
+  return true;
+}
+
+// Turns the top frame into one for lam called with the argn values at
+// args, binding the first n, for a call whose value the frame's own lambda
+// returns as it is. Takes over fn and the arguments. Locals the new frame
+// does not bind start with the value of the same local in the old one,
+// which is what they would have read through it.
+static void reuse_frame(KLambda *lam, KObj *fn, KObj **args, size_t argn,
+                        size_t n) {
+  Frame *f = &frames[env_top];
+  const Chunk *chunk = lambda_code(lam), *from = f->chunk;
+  if (chunk == from) {
+    // the same locals: rebind the arguments and keep the rest
+    for (size_t i = 0; i < n; i++) {
+      release_object(f->slots[i]);
+      f->slots[i] = args[i];
+    }
+    for (size_t i = n; i < argn; i++)
+      release_object(args[i]);
+    release_object(f->fn);
+    f->lam = lam;
+    f->fn = fn;
+    vm_sp = f->slots + chunk->slot_count;
+    return;
+  }
+  ArenaMark scratch = arena_mark(&global_arena);
+  KObj **next = (KObj **)arena_alloc(&global_arena,
+                                     sizeof(KObj *) * (chunk->slot_count + 1));
+  for (size_t i = 0; i < chunk->slot_count; i++) {
+    next[i] = i < n ? args[i] : NULL;
+    for (size_t j = from->slot_count; i >= n && j-- > 0;) {
+      if (from->names[j] == chunk->names[i]) {
+        next[i] = f->slots[j];
+        f->slots[j] = NULL;
+        break;
+      }
+    }
+  }
+  for (size_t i = n; i < argn; i++)
+    release_object(args[i]);
+  for (size_t i = 0; i < from->slot_count; i++)
+    release_object(f->slots[i]);
+  release_object(f->fn);
+  vm_enter(f->mark.block, f->mark.sp);
+  f->mark = vm_reserve(chunk->slot_count + chunk->max_stack);
+  f->slots = vm_sp;
+  memcpy(f->slots, next, chunk->slot_count * sizeof(KObj *));
+  arena_release(&global_arena, scratch);
+  shadow(from, -1);
+  shadow(chunk, 1);
+  f->chunk = chunk;
+  f->lam = lam;
+  f->fn = fn;
+  vm_sp = f->slots + chunk->slot_count;
+}
+
+// Whether the call at site s of chunk runs fn with argn arguments in the
+// caller's loop, as a lambda called in full, binding *bind of them. The
+// site remembers a global lambda, to know it again by the global's version.
+static bool call_site(CallSite *s, const Chunk *chunk, KObj *fn, size_t argn,
+                      size_t *bind) {
+  if (s->entry && s->fn == fn && globals[s->entry - 1].version == s->version) {
+    *bind = s->bind;
+    return true;
+  }
+  s->entry = 0;
+  if (fn->type != LAMBDA || !full_call(fn->as.lambda, argn, bind))
+    return false;
+  s->reuse = s->tail && covers(lambda_code(fn->as.lambda), chunk);
+  VarEntry *e = s->name ? global_entry(s->name) : NULL;
+  if (e && e->value == fn) {
+    s->entry = (uint32_t)(e - globals) + 1;
+    s->version = e->version;
+    s->fn = fn;
+    s->bind = (uint32_t)*bind;
+  }
+  return true;
+}
+
+// The lambda site s cached, when its global still holds it and no running
+// frame has a local of the same name; NULL otherwise.
+static KObj *site_global(const CallSite *s) {
+  if (!s->entry || globals[s->entry - 1].version != s->version)
+    return NULL;
+  uint32_t id = sym_id(s->name);
+  return id < shadow_cap && shadows[id] ? NULL : (KObj *)s->fn;
+}
+
+// The value of the lambda fn, called in full with argn arguments binding
+// bind of them, when the JIT takes the call; it consumes fn and the
+// arguments then. NULL leaves them to the bytecode.
+static KObj *jit_inline(KObj *fn, KObj **args, size_t argn, size_t bind) {
+  KObj *v = jit_call(fn->as.lambda, args, bind);
+  if (!v)
+    return NULL;
+  for (size_t i = 0; i < argn; i++)
+    release_object(args[i]);
+  release_object(fn);
+  return v;
+}
+
+static bool truthy(KObj *v) {
+  if (v->type == INT)
+    return v->as.int_value != 0;
+  if (v->type == FLOAT)
+    return v->as.float_value != 0.0;
+  return true;
+}
+
+// Runs chunk to its value. A lambda it calls with all its arguments runs
+// here too, in a frame above entry, rather than in a nested run().
+static KObj *run(const Chunk *chunk) {
+  StackMark mark = vm_reserve(chunk->max_stack);
+  size_t entry = env_top;
+  KObj **base = vm_sp;
+  KObj **slots = env_top > 0 ? frames[env_top].slots : NULL;
+  const uint32_t *code = chunk->code;
+  const void *const *pool = chunk->pool;
+  KObj **sp = base;
+  size_t pc = 0;
+#define NODE(i) ((ASTNode *)pool[code[i]])
+#define LITERAL(i) (NODE(i)->as.literal.value)
+  // switch to the top frame, just entered or reused
+#define START()                                                                \
+  do {                                                                         \
+    chunk = frames[env_top].chunk;                                             \
+    code = chunk->code;                                                        \
+    pool = chunk->pool;                                                        \
+    slots = frames[env_top].slots;                                             \
+    base = sp = vm_sp;                                                         \
+    pc = 0;                                                                    \
+  } while (0)
+  // enter a frame for fn, a lambda taking all argn arguments at args
+#define ENTER(fn, args, argn, bind, top)                                       \
+  do {                                                                         \
+    KLambda *lam = (fn)->as.lambda;                                            \
+    push_frame(lam, lambda_code(lam), args, bind);                             \
+    Frame *f = &frames[env_top];                                               \
+    f->fn = fn;                                                                \
+    f->ret_chunk = chunk;                                                      \
+    f->ret_slots = slots;                                                      \
+    f->ret_base = base;                                                        \
+    f->ret_sp = top;                                                           \
+    f->ret_pc = pc;                                                            \
+    f->ret_at = at;                                                            \
+    for (size_t i = 0; i < (argn); i++)                                        \
+      release_object((args)[i]);                                               \
+    START();                                                                   \
+  } while (0)
+  // leave the top frame with the value its body gave, back into the caller
+#define LEAVE()                                                                \
+  do {                                                                         \
+    Frame *f = &frames[env_top];                                               \
+    chunk = f->ret_chunk;                                                      \
+    code = chunk->code;                                                        \
+    pool = chunk->pool;                                                        \
+    slots = f->ret_slots;                                                      \
+    base = f->ret_base;                                                        \
+    sp = f->ret_sp;                                                            \
+    pc = f->ret_pc;                                                            \
+    at = f->ret_at;                                                            \
+    v = pop_frame(v);                                                          \
+  } while (0)
+  for (;;) {
+    size_t at = pc;
+    KObj *v;
+    // anything called below may run a chunk of its own above our top
+    vm_sp = sp;
+    switch ((OpCode)code[pc++]) {
+    case OP_NIL:
+      v = create_nil();
+      break;
+    case OP_CONST:
+      v = LITERAL(pc++);
+      retain_object(v);
+      break;
+    case OP_LITERAL:
+      v = eval_literal(LITERAL(pc++));
+      break;
+    case OP_GET:
+      v = var_get(chunk, slots, code[pc++]);
+      break;
+    case OP_SET:
+      var_set(chunk, slots, code[pc++], sp[-1]);
+      continue;
+    case OP_POP:
+      release_object(*--sp);
+      continue;
+    case OP_UNARY: {
+      KObj *x = *--sp;
+      v = k_unary_owned(get_op_desc(code[pc++])->unary, x);
+      release_object(x);
+      break;
+    }
+    case OP_BINARY: {
+      KObj *r = *--sp, *l = *--sp;
+      v = k_binary_owned(get_op_desc(code[pc++])->binary, l, r);
+      release_object(l);
+      release_object(r);
+      break;
+    }
+    case OP_NYI:
+      for (uint32_t i = code[pc++]; i > 0; i--)
+        release_object(*--sp);
+      printf("^nyi\n");
+      v = create_nil();
+      break;
+    case OP_JUMP:
+      pc = code[pc];
+      continue;
+    case OP_JUMP_FALSE: {
+      KObj *cond = *--sp;
+      pc = truthy(cond) ? pc + 1 : code[pc];
+      release_object(cond);
+      continue;
+    }
+    case OP_LIST: {
+      uint32_t n = code[pc++];
+      v = create_vec(n);
+      for (KObj **p = sp - n; p < sp; p++) {
+        vector_append(v, *p);
+        release_object(*p);
+      }
+      sp -= n;
+      break;
+    }
+    case OP_ADVERB:
+      v = create_adverb(NODE(pc++)->as.adverb.op, *--sp);
+      break;
+    case OP_CALL: {
+      uint32_t n = code[pc];
+      CallSite *s = &chunk->sites[code[pc + 1]];
+      KObj **args = sp - n, *fn = args[-1];
+      size_t bind;
+      pc += 2;
+      if (call_site(s, chunk, fn, n, &bind)) {
+        if (jit_enabled && (v = jit_inline(fn, args, n, bind))) {
+          sp -= n + 1;
+          break;
+        }
+        if (s->reuse) {
+          reuse_frame(fn->as.lambda, fn, args, n, bind);
+          START();
+          continue;
+        }
+        if (env_top + 1 < MAX_DEPTH) {
+          ENTER(fn, args, n, bind, args - 1);
+          continue;
+        }
+      }
+      v = call_value(fn, args, n);
+      sp -= n + 1;
+      break;
+    }
+    case OP_PLACE: {
+      uint32_t i = code[pc], n = code[pc + 1];
+      KObj **args = sp - n, *first = args[0];
+      memmove(args, args + 1, i * sizeof(KObj *));
+      args[i] = first;
+      pc += 2;
+      continue;
+    }
+    case OP_UNLESS_ADVERB:
+      pc = sp[-1]->type == ADVERB ? pc + 1 : code[pc];
+      continue;
+    case OP_GET_UNIQUE:
+      v = var_get_unique(chunk, slots, code[pc]);
+      if (v->type != VECTOR && !(code[pc + 1] && v->type == DICT)) {
+        if (v->type != NIL)
+          printf("^type\n");
+        release_object(v);
+        v = create_nil();
+      }
+      pc += 2;
+      break;
+    case OP_CHECK_INT:
+      if (sp[-1]->type == INT)
+        continue;
+      printf("^type\n");
+      v = create_nil();
+      break;
+    case OP_AMEND: {
+      KObj *right = *--sp, *idx = *--sp, *vec = *--sp;
+      v = amend(vec, idx, right);
+      break;
+    }
+    case OP_AMEND_WALK: {
+      uint32_t n = code[pc++];
+      KObj **idxs = sp - n, *last = idxs[n - 1];
+      KObj *container = amend_walk(idxs[-1], idxs, n);
+      sp -= n + 1;
+      if (container->type == NIL) {
+        v = container;
+        break;
+      }
+      *sp++ = container;
+      v = last;
+      break;
+    }
+    case OP_AMEND_SET: {
+      KObj *right = *--sp, *last = *--sp, *container = *--sp;
+      vector_set(container, (size_t)last->as.int_value, right);
+      release_object(last);
+      release_object(container);
+      v = right;
+      break;
+    }
+    case OP_SELF_UPDATE: {
+      ASTNode *expr = NODE(pc + 1)->as.binary.right;
+      KObj *arg = expr->type == AST_BINARY ? *--sp : NULL;
+      v = eval_self_update(chunk, slots, code[pc], expr, arg);
+      pc += 2;
+      break;
+    }
+    case OP_ASSIGN_ERROR:
+      printf("^assign\n");
+      v = create_nil();
+      break;
+    case OP_RETURN:
+      v = *--sp;
+      if (env_top == entry) {
+        vm_enter(mark.block, mark.sp);
+        return v;
+      }
+      LEAVE();
+      break;
+    case OP_GET_UNARY: {
+      KObj *x = var_get(chunk, slots, code[pc]);
+      v = x;
+      if (x->type != NIL) {
+        v = k_unary_owned(get_op_desc(code[pc + 1])->unary, x);
+        release_object(x);
+      }
+      pc += 2;
+      break;
+    }
+    case OP_GET_GET_BINARY:
+    case OP_GET_CONST_BINARY:
+    case OP_CONST_GET_BINARY: {
+      OpCode op = (OpCode)code[at];
+      KObj *l, *r;
+      if (op == OP_CONST_GET_BINARY) {
+        l = LITERAL(pc);
+        retain_object(l);
+      } else {
+        l = var_get(chunk, slots, code[pc]);
+      }
+      v = l;
+      if (l->type != NIL) {
+        if (op == OP_GET_GET_BINARY || op == OP_CONST_GET_BINARY) {
+          r = var_get(chunk, slots, code[pc + 1]);
         } else {
-          if (idx->as.float_value >= 0)
-            i = (size_t)idx->as.float_value;
-          else
-            i = (size_t)-1;
+          r = LITERAL(pc + 1);
+          retain_object(r);
         }
-        if (i < current->as.vector->length) {
-          next = &current->as.vector->items[i];
-          retain_object(next);
+        v = r;
+        if (r->type != NIL)
+          v = k_binary_owned(get_op_desc(code[pc + 2])->binary, l, r);
+        release_object(l);
+        release_object(r);
+      }
+      pc += 3;
+      break;
+    }
+    case OP_GET_GET_CALL:
+    case OP_GET_CONST_CALL: {
+      CallSite *s = &chunk->sites[code[pc + 2]];
+      KObj *fn = site_global(s);
+      if (fn)
+        retain_object(fn);
+      else
+        fn = var_get(chunk, slots, code[pc]);
+      v = fn;
+      if (fn->type != NIL) {
+        KObj *arg;
+        if (code[at] == OP_GET_GET_CALL) {
+          arg = var_get(chunk, slots, code[pc + 1]);
         } else {
-          next = create_int(0);
+          arg = LITERAL(pc + 1);
+          retain_object(arg);
         }
-      } else if (idx->type == VECTOR) {
-        size_t idx_len = idx->as.vector->length;
-        KObj *res = create_vec(idx_len);
-        size_t vec_len = current->as.vector->length;
-        bool ok = true;
-        for (size_t j = 0; j < idx_len; j++) {
-          KObj *it = &idx->as.vector->items[j];
-          int64_t id;
-          if (it->type == INT) {
-            id = it->as.int_value;
-          } else if (it->type == FLOAT) {
-            id = (int64_t)it->as.float_value;
-          } else {
-            printf("^type\n");
-            ok = false;
-            break;
-          }
-          if (id < 0 || (size_t)id >= vec_len) {
-            printf("^length\n");
-            ok = false;
-            break;
+        size_t bind;
+        if (arg->type == NIL) {
+          release_object(fn);
+          v = arg;
+        } else if (call_site(s, chunk, fn, 1, &bind)) {
+          v = jit_enabled ? jit_inline(fn, &arg, 1, bind) : NULL;
+          if (!v && (s->reuse || env_top + 1 < MAX_DEPTH)) {
+            pc += 3;
+            if (s->reuse) {
+              reuse_frame(fn->as.lambda, fn, &arg, 1, bind);
+              START();
+            } else {
+              ENTER(fn, &arg, 1, bind, sp);
+            }
+            continue;
           }
-          vector_append(res, &current->as.vector->items[id]);
-        }
-        if (!ok) {
-          release_object(res);
-          next = create_nil();
+          if (!v)
+            v = call_value(fn, &arg, 1);
         } else {
-          next = res;
+          v = call_value(fn, &arg, 1);
         }
-      } else {
-        printf("^type\n");
-        next = create_nil();
       }
-      release_object(idx);
-      release_object(current);
-      current = next;
-      if (current->type == NIL) {
-        for (size_t j = ai + 1; j < argn; j++)
-          release_object(args[j]);
-        free(args);
-        return current;
+      pc += 3;
+      break;
+    }
+    case OP_CALL_ADVERB: {
+      ASTNode *n = NODE(pc);
+      uint32_t argn = code[pc + 1];
+      KObj **args = sp - argn;
+      v = apply_adverb(n->as.adverb.op.type, args[-1], args, argn);
+      while (sp > args - 1)
+        release_object(*--sp);
+      pc += 2;
+      break;
+    }
+    case OP_FUSED: {
+      uint32_t n = code[pc + 2];
+      v = fused(chunk, slots, NODE(pc), code + pc + 3, n);
+      if (!v) {
+        pc += 3 + n;
+        continue;
       }
+      pc = code[pc + 1];
+      break;
     }
-    free(args);
-    return current;
-  }
-  case AST_SEQ: {
-    KObj *result = create_nil();
-    for (size_t i = 0; i < node->as.seq.count; i++) {
-      KObj *val = evaluate(node->as.seq.items[i]);
-      if (i > 0)
-        release_object(result);
-      result = val;
+    default:
+      v = create_nil();
+      break;
     }
-    return result;
-  }
-  case AST_LIST: {
-    KObj *vec = create_vec(node->as.seq.count);
-    for (size_t i = 0; i < node->as.seq.count; i++) {
-      KObj *val = evaluate(node->as.seq.items[i]);
-      vector_append(vec, val);
-      release_object(val);
+    *sp++ = v;
+    while (v->type == NIL) {
+      // unwind to the innermost guard around the failed instruction, out
+      // through the callers running here when there is none
+      const Guard *g = NULL;
+      for (size_t i = chunk->guard_count; i-- > 0;) {
+        if (chunk->guards[i].start <= at && at < chunk->guards[i].end) {
+          g = &chunk->guards[i];
+          break;
+        }
+      }
+      KObj **keep = base + (g ? g->depth : 0);
+      while (sp > keep)
+        release_object(*--sp);
+      if (g) {
+        *sp++ = create_nil();
+        pc = g->end;
+        break;
+      }
+      if (env_top == entry) {
+        vm_enter(mark.block, mark.sp);
+        return create_nil();
+      }
+      v = create_nil();
+      LEAVE();
+      *sp++ = v;
     }
-    return vec;
   }
+#undef NODE
+#undef LITERAL
+#undef START
+#undef ENTER
+#undef LEAVE
+}
+
+// Compiles node into the statement arena and runs it.
+KObj *evaluate(ASTNode *node) {
+  return run(compile(&node, 1, &global_arena));
+}
+
+bool atomic_lambda(KObj *fn, KObj **args, size_t argn) {
+  KLambda *lam = fn->as.lambda;
+  const Chunk *chunk = lambda_code(lam);
+  size_t arity = lam->param_count > 0 ? (size_t)lam->param_count
+                                      : (size_t)chunk->arity;
+  if (!chunk->atomic || argn != arity)
+    return false;
+  // a list the body never reads would not shape the result
+  for (size_t i = 0; i < argn; i++)
+    if (args[i]->type == VECTOR && !(chunk->reads >> i & 1))
+      return false;
+  return true;
+}
+
+// Runs lam in a new frame with its first n locals bound to args.
+static KObj *call_lambda(KLambda *lam, KObj **args, size_t n) {
+  const Chunk *chunk = lambda_code(lam);
+  if (env_top + 1 >= MAX_DEPTH || nested >= MAX_NESTED) {
+    printf("^stack\n");
+    return create_nil();
+  }
+  if (jit_enabled) {
+    KObj *v = jit_call(lam, args, n);
+    if (v)
+      return v;
   }
-  return create_nil();
+  push_frame(lam, chunk, args, n);
+  nested++;
+  KObj *result = run(chunk);
+  nested--;
+  return pop_frame(result);
 }
 
 KObj *call_unary(KObj *fn, KObj *arg) {
@@ -703,28 +1475,11 @@ KObj *call_unary(KObj *fn, KObj *arg) {
     KObj *args[1] = {arg};
     return call_n(fn, args, 1);
   }
-  if (fn->type == LAMBDA) {
-    env_push();
-    KLambda *lam = fn->as.lambda;
-    if (lam->param_count > 0) {
-      env_set(lam->params[0], arg);
-    } else {
-      env_set("x", arg);
-    }
-    KObj *result = create_nil();
-    for (size_t i = 0; i < lam->body_count; i++) {
-      release_object(result);
-      result = evaluate(lam->body[i]);
-    }
-    if (!lam->has_return) {
-      release_object(result);
-      result = create_nil();
-    }
-    env_pop();
-    return result;
-  }
+  if (fn->type == LAMBDA)
+    return call_lambda(fn->as.lambda, &arg, 1);
   if (fn->type == VERB) {
     if (fn->as.verb.unary) {
+      vector_force(arg);
       return fn->as.verb.unary(arg);
     }
     printf("^rank\n");
@@ -740,32 +1495,13 @@ KObj *call_binary(KObj *fn, KObj *left, KObj *right) {
     return call_n(fn, args, 2);
   }
   if (fn->type == LAMBDA) {
-    env_push();
-    KLambda *lam = fn->as.lambda;
-    if (lam->param_count > 0) {
-      env_set(lam->params[0], left);
-      if (lam->param_count > 1) {
-        env_set(lam->params[1], right);
-      } else {
-        env_set("y", right);
-      }
-    } else {
-      env_set("x", left);
-      env_set("y", right);
-    }
-    KObj *result = create_nil();
-    for (size_t i = 0; i < lam->body_count; i++) {
-      release_object(result);
-      result = evaluate(lam->body[i]);
-    }
-    if (!lam->has_return) {
-      release_object(result);
-      result = create_nil();
-    }
-    env_pop();
-    return result;
+    KObj *args[2] = {left, right};
+    return call_lambda(fn->as.lambda, args,
+                       fn->as.lambda->param_count == 1 ? 1 : 2);
   }
   if (fn->type == VERB && fn->as.verb.binary) {
+    vector_force(left);
+    vector_force(right);
     return fn->as.verb.binary(left, right);
   }
   printf("^rank\n");
@@ -776,74 +1512,33 @@ KObj *call_n(KObj *fn, KObj **args, size_t argn) {
   if (fn->type == PROJ) {
     KProj *p = fn->as.proj;
     size_t total = p->argn + argn;
-    if (total < p->arity) {
-      KObj **combined = NULL;
-      if (total > 0) {
-        combined = (KObj **)malloc(sizeof(KObj *) * total);
-        for (size_t i = 0; i < p->argn; i++)
-          combined[i] = p->args[i];
-        for (size_t i = 0; i < argn; i++)
-          combined[p->argn + i] = args[i];
-      }
-      KObj *np = create_projection(p->fn, combined, total, p->arity);
-      if (combined)
-        free(combined);
-      return np;
-    }
-    size_t n = total;
-    KObj **combined = (KObj **)malloc(sizeof(KObj *) * n);
+    ArenaMark scratch = arena_mark(&global_arena);
+    KObj **combined =
+        (KObj **)arena_alloc(&global_arena, sizeof(KObj *) * (total + 1));
     for (size_t i = 0; i < p->argn; i++)
       combined[i] = p->args[i];
     for (size_t i = 0; i < argn; i++)
       combined[p->argn + i] = args[i];
-    KObj *res = call_n(p->fn, combined, n);
-    free(combined);
+    KObj *res = total < p->arity
+                    ? create_projection(p->fn, combined, total, p->arity)
+                    : call_n(p->fn, combined, total);
+    arena_release(&global_arena, scratch);
     return res;
   }
   if (fn->type == LAMBDA) {
-    int arity = fn->as.lambda->param_count;
-    if (arity <= 0) {
-      KLambda *lam_scan = fn->as.lambda;
-      int max_idx = 0; // - x/y/z
-      for (size_t i = 0; i < lam_scan->body_count; i++) {
-        int t = scan_node(lam_scan->body[i]);
-        if (t > max_idx)
-          max_idx = t;
-      }
-      arity = max_idx; // 0..3
-      if (arity == 0)
-        arity = 0;
-    }
+    KLambda *lam = fn->as.lambda;
+    int arity = lam->param_count;
+    if (arity <= 0)
+      arity = lambda_code(lam)->arity; // 0..3
     if ((int)argn < arity) {
       return create_projection(fn, args, argn, (size_t)arity);
     }
-    env_push();
-    KLambda *lam = fn->as.lambda;
-    if (lam->param_count > 0) {
-      size_t n = lam->param_count < (int)argn ? (size_t)lam->param_count : argn;
-      for (size_t i = 0; i < n; i++) {
-        env_set(lam->params[i], args[i]);
-      }
-    } else {
-      const char *defaults[] = {"x", "y", "z"};
-      size_t n = argn < 3 ? argn : 3;
-      for (size_t i = 0; i < n; i++) {
-        env_set(defaults[i], args[i]);
-      }
-    }
-    KObj *result = create_nil();
-    for (size_t i = 0; i < lam->body_count; i++) {
-      release_object(result);
-      result = evaluate(lam->body[i]);
-    }
-    if (!lam->has_return) {
-      release_object(result);
-      result = create_nil();
-    }
-    env_pop();
-    return result;
+    size_t bound = lam->param_count > 0 ? (size_t)lam->param_count : 3;
+    return call_lambda(lam, args, argn < bound ? argn : bound);
   }
   if (fn->type == VERB) {
+    for (size_t i = 0; i < argn; i++)
+      vector_force(args[i]);
     if (argn == 1 && fn->as.verb.unary)
       return fn->as.verb.unary(args[0]);
     if (argn == 2 && fn->as.verb.binary)
@@ -854,62 +1549,3 @@ KObj *call_n(KObj *fn, KObj **args, size_t argn) {
   printf("^type\n");
   return create_nil();
 }
-
-static int scan_node(ASTNode *n) {
-  if (!n)
-    return 0;
-  switch (n->type) {
-  case AST_VAR: {
-    const char *nm = n->as.var.name;
-    if (!nm)
-      return 0;
-    if (strcmp(nm, "x") == 0)
-      return 1;
-    if (strcmp(nm, "y") == 0)
-      return 2;
-    if (strcmp(nm, "z") == 0)
-      return 3;
-    return 0;
-  }
-  case AST_LITERAL:
-    return 0;
-  case AST_UNARY:
-    return scan_node(n->as.unary.child);
-  case AST_BINARY: {
-    int a = scan_node(n->as.binary.left);
-    int b = scan_node(n->as.binary.right);
-    return a > b ? a : b;
-  }
-  case AST_CALL: {
-    int m = scan_node(n->as.call.callee);
-    for (size_t i = 0; i < n->as.call.arg_count; i++) {
-      int t = scan_node(n->as.call.args[i]);
-      if (t > m)
-        m = t;
-    }
-    return m;
-  }
-  case AST_SEQ:
-  case AST_LIST: {
-    int m = 0;
-    for (size_t i = 0; i < n->as.seq.count; i++) {
-      int t = scan_node(n->as.seq.items[i]);
-      if (t > m)
-        m = t;
-    }
-    return m;
-  }
-  case AST_CONDITIONAL: {
-    int a = scan_node(n->as.conditional.condition);
-    int b = scan_node(n->as.conditional.then_branch);
-    int c = scan_node(n->as.conditional.else_branch);
-    int m = a > b ? a : b;
-    if (c > m)
-      m = c;
-    return m;
-  }
-  case AST_ADVERB:
-    return scan_node(n->as.adverb.child);
-  }
-  return 0;
-}
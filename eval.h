@@ -6,8 +6,12 @@
 
 KObj *evaluate(ASTNode *node);
 void env_dump();
+void env_footprint();
 KObj *call_unary(KObj *fn, KObj *arg);
 KObj *call_binary(KObj *fn, KObj *left, KObj *right);
 KObj *call_n(KObj *fn, KObj **args, size_t argn);
+// Whether calling the lambda fn on args maps it over the items of the lists
+// among them, as its each would.
+bool atomic_lambda(KObj *fn, KObj **args, size_t argn);
 
 #endif
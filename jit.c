@@ -0,0 +1,483 @@
+#define _DEFAULT_SOURCE
+#include "jit.h"
+#include "ast.h"
+#include "compile.h"
+#include "def.h"
+#include "token.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool jit_enabled = false;
+size_t jit_compiled, jit_rejected;
+
+// Parameters the code can read, one bit each in a signature: set for a
+// float, clear for an int.
+#define JIT_ARGS 4
+#define JIT_SIGS (1u << JIT_ARGS)
+
+// Reads the parameters from args as raw 8-byte values and stores the
+// result in out; returns 0 to hand the call back to the bytecode.
+typedef int (*JitFn)(const uint64_t *args, uint64_t *out);
+
+enum { SIG_UNTRIED, SIG_DONE, SIG_REJECTED };
+
+struct JitCode {
+  bool reject;       // the body is out of reach for any arguments
+  unsigned uses;     // parameters the body reads, by bit
+  uint8_t state[JIT_SIGS];
+  bool floats[JIT_SIGS]; // the result is a float
+  JitFn fn[JIT_SIGS];
+  void *mem[JIT_SIGS];
+  size_t size[JIT_SIGS];
+};
+
+// The slot of the parameter name refers to in lam, or -1 when it is no
+// parameter the code can read. The last of repeated parameters wins.
+static int param_slot(KLambda *lam, const char *name) {
+  const Chunk *chunk = lam->code;
+  size_t params = lam->param_count > 0 ? (size_t)lam->param_count : 3;
+  for (size_t i = chunk->slot_count; i-- > 0;) {
+    if (chunk->names[i] == name)
+      return i < params && i < JIT_ARGS ? (int)i : -1;
+  }
+  return -1;
+}
+
+static bool jit_binary_op(TokenType op) {
+  switch (op) {
+  case PLUS:
+  case MINUS:
+  case STAR:
+  case PERCENT:
+  case AMP:
+  case BAR:
+  case LESS:
+  case MORE:
+  case EQUAL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Whether n is within reach whatever the argument types, adding the
+// parameters it reads to uses.
+static bool shape(KLambda *lam, ASTNode *n, unsigned *uses) {
+  if (!n)
+    return false;
+  switch (n->type) {
+  case AST_LITERAL:
+    return n->as.literal.value->type == INT ||
+           n->as.literal.value->type == FLOAT;
+  case AST_VAR: {
+    int slot = param_slot(lam, n->as.var.name);
+    if (slot < 0)
+      return false;
+    *uses |= 1u << slot;
+    return true;
+  }
+  case AST_UNARY:
+    return n->as.unary.op.type == MINUS &&
+           shape(lam, n->as.unary.child, uses);
+  case AST_BINARY:
+    return jit_binary_op(n->as.binary.op.type) &&
+           shape(lam, n->as.binary.left, uses) &&
+           shape(lam, n->as.binary.right, uses);
+  case AST_CONDITIONAL:
+    return shape(lam, n->as.conditional.condition, uses) &&
+           shape(lam, n->as.conditional.then_branch, uses) &&
+           shape(lam, n->as.conditional.else_branch, uses);
+  default:
+    return false;
+  }
+}
+
+#ifdef JIT_X86_64
+
+// Code for one signature, grown in a malloc'd buffer. An int value lives
+// in rax and a float in xmm0; the right operand of a verb waits in a stack
+// slot below rbp while the left one is worked out.
+typedef struct {
+  uint8_t *buf;
+  size_t len, cap;
+  KLambda *lam;
+  unsigned sig;
+  size_t depth, max_depth;
+  size_t *bails; // rel32 fields to point at the give-up exit
+  size_t bail_len, bail_cap;
+  bool ok;
+} Jit;
+
+typedef enum { J_INT, J_FLOAT } JitType;
+
+static void put(Jit *j, const uint8_t *bytes, size_t n) {
+  if (j->len + n > j->cap) {
+    size_t cap = j->cap ? j->cap * 2 : 256;
+    while (cap < j->len + n)
+      cap *= 2;
+    uint8_t *buf = (uint8_t *)realloc(j->buf, cap);
+    if (!buf) {
+      j->ok = false;
+      return;
+    }
+    j->buf = buf;
+    j->cap = cap;
+  }
+  memcpy(j->buf + j->len, bytes, n);
+  j->len += n;
+}
+
+#define BYTES(j, ...)                                                          \
+  put(j, (const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}))
+
+static void put32(Jit *j, uint32_t v) {
+  uint8_t b[4];
+  for (int i = 0; i < 4; i++)
+    b[i] = (uint8_t)(v >> (8 * i));
+  put(j, b, 4);
+}
+
+static void put64(Jit *j, uint64_t v) {
+  put32(j, (uint32_t)v);
+  put32(j, (uint32_t)(v >> 32));
+}
+
+// A rel32 operand left open; land() points it here.
+static size_t hole(Jit *j) {
+  put32(j, 0);
+  return j->len - 4;
+}
+
+static void land(Jit *j, size_t at) {
+  if (!j->ok)
+    return;
+  uint32_t rel = (uint32_t)(j->len - (at + 4));
+  for (int i = 0; i < 4; i++)
+    j->buf[at + i] = (uint8_t)(rel >> (8 * i));
+}
+
+static void bail_if_equal(Jit *j) {
+  BYTES(j, 0x0F, 0x84); // je
+  size_t at = hole(j);
+  if (j->bail_len == j->bail_cap) {
+    j->bail_cap = j->bail_cap ? j->bail_cap * 2 : 8;
+    size_t *bails = (size_t *)realloc(j->bails, j->bail_cap * sizeof(size_t));
+    if (!bails) {
+      j->ok = false;
+      return;
+    }
+    j->bails = bails;
+  }
+  j->bails[j->bail_len++] = at;
+}
+
+static int32_t slot_disp(size_t slot) { return -8 * (int32_t)(slot + 1); }
+
+// xmm0 = (double)rax
+static void int_to_float(Jit *j) { BYTES(j, 0xF2, 0x48, 0x0F, 0x2A, 0xC0); }
+
+// rax = al, a comparison's 0 or 1
+static void flag_to_int(Jit *j) { BYTES(j, 0x0F, 0xB6, 0xC0); }
+
+static JitType emit_node(Jit *j, ASTNode *n);
+
+static JitType emit_binary(Jit *j, ASTNode *n) {
+  TokenType op = n->as.binary.op.type;
+  JitType r = emit_node(j, n->as.binary.right);
+  size_t slot = j->depth++;
+  if (j->depth > j->max_depth)
+    j->max_depth = j->depth;
+  int32_t disp = slot_disp(slot);
+  if (r == J_INT)
+    BYTES(j, 0x48, 0x89, 0x85); // mov [rbp+disp], rax
+  else
+    BYTES(j, 0xF2, 0x0F, 0x11, 0x85); // movsd [rbp+disp], xmm0
+  put32(j, (uint32_t)disp);
+  JitType l = emit_node(j, n->as.binary.left);
+  j->depth--;
+  if (op != PERCENT && op != EQUAL && l == J_INT && r == J_INT) {
+    BYTES(j, 0x48, 0x8B, 0x8D); // mov rcx, [rbp+disp]
+    put32(j, (uint32_t)disp);
+    BYTES(j, 0x48);
+    switch (op) {
+    case PLUS:
+      BYTES(j, 0x01, 0xC8); // add rax, rcx
+      return J_INT;
+    case MINUS:
+      BYTES(j, 0x29, 0xC8); // sub rax, rcx
+      return J_INT;
+    case STAR:
+      BYTES(j, 0x0F, 0xAF, 0xC1); // imul rax, rcx
+      return J_INT;
+    default:
+      break;
+    }
+    BYTES(j, 0x39, 0xC8); // cmp rax, rcx
+    switch (op) {
+    case AMP:
+      BYTES(j, 0x48, 0x0F, 0x4D, 0xC1); // cmovge rax, rcx
+      return J_INT;
+    case BAR:
+      BYTES(j, 0x48, 0x0F, 0x4E, 0xC1); // cmovle rax, rcx
+      return J_INT;
+    case LESS:
+      BYTES(j, 0x0F, 0x9C, 0xC0); // setl al
+      break;
+    default:
+      BYTES(j, 0x0F, 0x9F, 0xC0); // setg al
+      break;
+    }
+    flag_to_int(j);
+    return J_INT;
+  }
+  // ints meet floats as doubles, as do x%y and x=y
+  if (l == J_INT)
+    int_to_float(j);
+  if (r == J_INT) {
+    BYTES(j, 0x48, 0x8B, 0x8D); // mov rcx, [rbp+disp]
+    put32(j, (uint32_t)disp);
+    BYTES(j, 0xF2, 0x48, 0x0F, 0x2A, 0xC9); // cvtsi2sd xmm1, rcx
+  } else {
+    BYTES(j, 0xF2, 0x0F, 0x10, 0x8D); // movsd xmm1, [rbp+disp]
+    put32(j, (uint32_t)disp);
+  }
+  switch (op) {
+  case PLUS:
+    BYTES(j, 0xF2, 0x0F, 0x58, 0xC1); // addsd xmm0, xmm1
+    return J_FLOAT;
+  case MINUS:
+    BYTES(j, 0xF2, 0x0F, 0x5C, 0xC1); // subsd
+    return J_FLOAT;
+  case STAR:
+    BYTES(j, 0xF2, 0x0F, 0x59, 0xC1); // mulsd
+    return J_FLOAT;
+  case PERCENT:
+    // x%0 is an infinity, which only the bytecode can make
+    BYTES(j, 0x66, 0x0F, 0x57, 0xD2); // xorpd xmm2, xmm2
+    BYTES(j, 0x66, 0x0F, 0x2E, 0xCA); // ucomisd xmm1, xmm2
+    bail_if_equal(j);
+    BYTES(j, 0xF2, 0x0F, 0x5E, 0xC1); // divsd
+    return J_FLOAT;
+  case AMP:
+    BYTES(j, 0xF2, 0x0F, 0x5D, 0xC1); // minsd: xmm0 < xmm1 ? xmm0 : xmm1
+    return J_FLOAT;
+  case BAR:
+    BYTES(j, 0xF2, 0x0F, 0x5F, 0xC1); // maxsd: xmm0 > xmm1 ? xmm0 : xmm1
+    return J_FLOAT;
+  case LESS:
+    BYTES(j, 0x66, 0x0F, 0x2E, 0xC8); // ucomisd xmm1, xmm0
+    BYTES(j, 0x0F, 0x97, 0xC0);       // seta al
+    break;
+  case MORE:
+    BYTES(j, 0x66, 0x0F, 0x2E, 0xC1); // ucomisd xmm0, xmm1
+    BYTES(j, 0x0F, 0x97, 0xC0);       // seta al
+    break;
+  default:
+    BYTES(j, 0x66, 0x0F, 0x2E, 0xC1); // ucomisd xmm0, xmm1
+    BYTES(j, 0x0F, 0x94, 0xC0);       // sete al
+    BYTES(j, 0x0F, 0x9B, 0xC1);       // setnp cl
+    BYTES(j, 0x20, 0xC8);             // and al, cl
+    break;
+  }
+  flag_to_int(j);
+  return J_INT;
+}
+
+static JitType emit_node(Jit *j, ASTNode *n) {
+  switch (n->type) {
+  case AST_LITERAL: {
+    KObj *v = n->as.literal.value;
+    uint64_t bits;
+    if (v->type == INT)
+      memcpy(&bits, &v->as.int_value, sizeof(bits));
+    else
+      memcpy(&bits, &v->as.float_value, sizeof(bits));
+    BYTES(j, 0x48, 0xB8); // mov rax, imm64
+    put64(j, bits);
+    if (v->type == INT)
+      return J_INT;
+    BYTES(j, 0x66, 0x48, 0x0F, 0x6E, 0xC0); // movq xmm0, rax
+    return J_FLOAT;
+  }
+  case AST_VAR: {
+    int slot = param_slot(j->lam, n->as.var.name);
+    uint8_t disp = (uint8_t)(8 * slot);
+    if (j->sig & (1u << slot)) {
+      BYTES(j, 0xF2, 0x0F, 0x10, 0x47, disp); // movsd xmm0, [rdi+disp]
+      return J_FLOAT;
+    }
+    BYTES(j, 0x48, 0x8B, 0x47, disp); // mov rax, [rdi+disp]
+    return J_INT;
+  }
+  case AST_UNARY:
+    // -x is 0.0-x, a float whatever x is
+    if (emit_node(j, n->as.unary.child) == J_INT)
+      BYTES(j, 0xF2, 0x48, 0x0F, 0x2A, 0xC8); // cvtsi2sd xmm1, rax
+    else
+      BYTES(j, 0x66, 0x0F, 0x28, 0xC8); // movapd xmm1, xmm0
+    BYTES(j, 0x66, 0x0F, 0x57, 0xC0);   // xorpd xmm0, xmm0
+    BYTES(j, 0xF2, 0x0F, 0x5C, 0xC1);   // subsd xmm0, xmm1
+    return J_FLOAT;
+  case AST_BINARY:
+    return emit_binary(j, n);
+  case AST_CONDITIONAL: {
+    if (emit_node(j, n->as.conditional.condition) == J_INT) {
+      BYTES(j, 0x48, 0x85, 0xC0); // test rax, rax
+    } else {
+      BYTES(j, 0x66, 0x0F, 0x57, 0xC9); // xorpd xmm1, xmm1
+      BYTES(j, 0x66, 0x0F, 0x2E, 0xC1); // ucomisd xmm0, xmm1
+      BYTES(j, 0x7A, 0x06);             // jp past the je: NaN is true
+    }
+    BYTES(j, 0x0F, 0x84); // je
+    size_t other = hole(j);
+    JitType t = emit_node(j, n->as.conditional.then_branch);
+    BYTES(j, 0xE9); // jmp
+    size_t done = hole(j);
+    land(j, other);
+    // both branches must leave their value in the same register
+    if (emit_node(j, n->as.conditional.else_branch) != t)
+      j->ok = false;
+    land(j, done);
+    return t;
+  }
+  default:
+    j->ok = false;
+    return J_INT;
+  }
+}
+
+// Compiles the body of lam for the argument types in sig into executable
+// memory; false when the branches of a $[;;] disagree on their type.
+static bool compile_sig(JitCode *jc, KLambda *lam, unsigned sig) {
+  Jit j = {0};
+  j.lam = lam;
+  j.sig = sig;
+  j.ok = true;
+  BYTES(&j, 0x55);                   // push rbp
+  BYTES(&j, 0x48, 0x89, 0xE5);       // mov rbp, rsp
+  BYTES(&j, 0x48, 0x81, 0xEC);       // sub rsp, imm32
+  size_t frame = hole(&j);
+  JitType t = emit_node(&j, lam->code->body[0]);
+  if (t == J_INT)
+    BYTES(&j, 0x48, 0x89, 0x06); // mov [rsi], rax
+  else
+    BYTES(&j, 0xF2, 0x0F, 0x11, 0x06); // movsd [rsi], xmm0
+  BYTES(&j, 0xB8, 0x01, 0x00, 0x00, 0x00); // mov eax, 1
+  BYTES(&j, 0xC9, 0xC3);                   // leave; ret
+  for (size_t i = 0; i < j.bail_len; i++)
+    land(&j, j.bails[i]);
+  BYTES(&j, 0x31, 0xC0, 0xC9, 0xC3); // xor eax, eax; leave; ret
+  bool ok = j.ok;
+  if (ok) {
+    uint32_t size = (uint32_t)((j.max_depth * 8 + 15) & ~(size_t)15);
+    memcpy(j.buf + frame, &size, sizeof(size));
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t len = (j.len + page - 1) / page * page;
+    void *mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ok = mem != MAP_FAILED;
+    if (ok) {
+      memcpy(mem, j.buf, j.len);
+      ok = mprotect(mem, len, PROT_READ | PROT_EXEC) == 0;
+      if (!ok)
+        munmap(mem, len);
+    }
+    if (ok) {
+      jc->mem[sig] = mem;
+      jc->size[sig] = len;
+      jc->floats[sig] = t == J_FLOAT;
+      // ISO C has no cast from object to function pointers
+      memcpy(&jc->fn[sig], &mem, sizeof(mem));
+    }
+  }
+  free(j.buf);
+  free(j.bails);
+  return ok;
+}
+
+#else
+
+static bool compile_sig(JitCode *jc, KLambda *lam, unsigned sig) {
+  (void)jc;
+  (void)lam;
+  (void)sig;
+  return false;
+}
+
+#endif
+
+static JitCode *jit_prepare(KLambda *lam) {
+  JitCode *jc = (JitCode *)calloc(1, sizeof(JitCode));
+  if (!jc)
+    return NULL;
+  const Chunk *chunk = lam->code;
+  jc->reject = !lam->has_return || chunk->body_count != 1 ||
+               !shape(lam, chunk->body[0], &jc->uses);
+  if (jc->reject)
+    jit_rejected++;
+  return jc;
+}
+
+KObj *jit_call(KLambda *lam, KObj **args, size_t n) {
+  if (!lam->code)
+    lam->code = compile_lambda(lam);
+  Chunk *chunk = lam->code;
+  if (!chunk->jit && !(chunk->jit = jit_prepare(lam)))
+    return NULL;
+  JitCode *jc = chunk->jit;
+  if (jc->reject || (n < JIT_ARGS && jc->uses >> n))
+    return NULL;
+  uint64_t vals[JIT_ARGS] = {0};
+  unsigned sig = 0;
+  for (size_t i = 0; i < JIT_ARGS; i++) {
+    if (!(jc->uses & (1u << i)))
+      continue;
+    KObj *a = args[i];
+    if (a->type == INT) {
+      memcpy(&vals[i], &a->as.int_value, sizeof(uint64_t));
+    } else if (a->type == FLOAT) {
+      memcpy(&vals[i], &a->as.float_value, sizeof(uint64_t));
+      sig |= 1u << i;
+    } else {
+      return NULL;
+    }
+  }
+  if (jc->state[sig] == SIG_UNTRIED) {
+    bool ok = compile_sig(jc, lam, sig);
+    jc->state[sig] = ok ? SIG_DONE : SIG_REJECTED;
+    if (ok)
+      jit_compiled++;
+    else
+      jit_rejected++;
+  }
+  uint64_t out;
+  if (jc->state[sig] != SIG_DONE || !jc->fn[sig](vals, &out))
+    return NULL;
+  if (jc->floats[sig]) {
+    double f;
+    memcpy(&f, &out, sizeof(f));
+    return create_float(f);
+  }
+  int64_t i;
+  memcpy(&i, &out, sizeof(i));
+  return create_int(i);
+}
+
+void jit_free(JitCode *jit) {
+  if (!jit)
+    return;
+#ifdef JIT_X86_64
+  for (unsigned s = 0; s < JIT_SIGS; s++) {
+    if (jit->mem[s])
+      munmap(jit->mem[s], jit->size[s]);
+  }
+#endif
+  free(jit);
+}
@@ -0,0 +1,28 @@
+#ifndef JIT_H_
+#define JIT_H_
+
+#include "compile.h"
+#include "def.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Native x86-64 code for lambdas whose body is one expression of numbers,
+// parameters, arithmetic, comparisons and $[;;]. A lambda is compiled for
+// each combination of int and float arguments it is called with; anything
+// else runs as bytecode. Off until \jit turns it on.
+
+extern bool jit_enabled;
+// lambdas compiled for a combination of argument types, and given up on
+extern size_t jit_compiled, jit_rejected;
+
+typedef struct JitCode JitCode;
+
+// The value of lam on its first n locals args, or NULL when the JIT does
+// not take the call: the body is out of its reach, an argument it reads is
+// no number, or the code gave up on the values, such as on a division by
+// zero. The bytecode then runs the call instead.
+KObj *jit_call(KLambda *lam, KObj **args, size_t n);
+
+void jit_free(JitCode *jit);
+
+#endif
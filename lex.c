@@ -109,9 +109,15 @@ static Token read_symbol(Lexer *lexer) {
   return token;
 }
 
+// Names may be dotted, as in .cfg.limit, with every part led by a letter.
 static Token read_ident(Lexer *lexer) {
-  while (isalnum(*lexer->current))
+  for (;;) {
+    while (isalnum(*lexer->current))
+      advance(lexer);
+    if (lexer->current[0] != '.' || !isalpha(lexer->current[1]))
+      break;
     advance(lexer);
+  }
   Token token = make_token(lexer, IDENT);
   const OpInfo *info = find_op_by_ident(token.start, token.length);
   if (info)
@@ -133,7 +139,7 @@ Token scan_token(Lexer *lexer) {
     return read_number(lexer);
   if (c == '"')
     return read_string(lexer);
-  if (isalpha(c))
+  if (isalpha(c) || (c == '.' && isalpha(*lexer->current)))
     return read_ident(lexer);
   const OpInfo *op = find_op_by_char(c);
   if (op)
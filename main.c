@@ -1,7 +1,10 @@
 #include "arena.h"
+#include "def.h"
 #include "repl.h"
+#include "slab.h"
 
 int main(int argc, char **argv) {
+  scalars_init();
   arena_init(&global_arena);
   int status = 0;
   if (argc > 1) {
@@ -10,5 +13,6 @@ int main(int argc, char **argv) {
     run_repl();
   }
   arena_dispose(&global_arena);
+  slab_dispose();
   return status;
 }
@@ -3,20 +3,30 @@
 #include <string.h>
 
 static const OpDesc op_table[] = {
-    [PLUS] = {k_flip, k_add},       [MINUS] = {k_negate, k_sub},
-    [STAR] = {k_first, k_mul},      [PERCENT] = {k_sqrt, k_div},
-    [AMP] = {k_where, k_min},       [BAR] = {k_rev, k_max},
-    [TILDE] = {k_not, k_match},     [CARET] = {k_sort, NULL},
-    [EQUAL] = {k_group, k_eq},      [LESS] = {k_asc, k_less},
-    [MORE] = {k_desc, k_more},      [BANG] = {k_enum, k_key},
-    [HASH] = {k_count, k_take},     [UNDERSCORE] = {k_floor, k_drop},
-    [COMMA] = {k_enlist, k_concat}, [EXP] = {k_exp, k_pow},
-    [RAND] = {k_rand, k_randb},     [LOG] = {k_log, k_logb},
-    [SIN] = {k_sin, NULL},          [COS] = {k_cos, NULL},
-    [ABS] = {k_abs, NULL},
+    [PLUS] = {k_flip, k_add, .atomic = ATOMIC_BINARY},
+    [MINUS] = {k_negate, k_sub, .atomic = ATOMIC_BOTH},
+    [STAR] = {k_first, k_mul, .atomic = ATOMIC_BINARY},
+    [PERCENT] = {k_sqrt, k_div, .atomic = ATOMIC_BOTH},
+    [AMP] = {k_where, k_min, .atomic = ATOMIC_BINARY},
+    [BAR] = {k_rev, k_max, .atomic = ATOMIC_BINARY},
+    [TILDE] = {k_not, k_match, .atomic = ATOMIC_UNARY},
+    [CARET] = {k_sort, NULL},
+    [EQUAL] = {k_group, k_eq, .atomic = ATOMIC_BINARY},
+    [LESS] = {k_asc, k_less, .atomic = ATOMIC_BINARY},
+    [MORE] = {k_desc, k_more, .atomic = ATOMIC_BINARY},
+    [BANG] = {k_enum, k_key},
+    [HASH] = {k_count, k_take},
+    [UNDERSCORE] = {k_floor, k_drop, .atomic = ATOMIC_UNARY},
+    [COMMA] = {k_enlist, k_concat},
+    [EXP] = {k_exp, k_pow, .atomic = ATOMIC_BOTH},
+    [RAND] = {k_rand, k_randb, true},
+    [LOG] = {k_log, k_logb, .atomic = ATOMIC_BOTH},
+    [SIN] = {k_sin, NULL, .atomic = ATOMIC_UNARY},
+    [COS] = {k_cos, NULL, .atomic = ATOMIC_UNARY},
+    [ABS] = {k_abs, NULL, .atomic = ATOMIC_UNARY},
 };
 
-static const OpDesc empty_desc = {NULL, NULL};
+static const OpDesc empty_desc = {NULL, NULL, false, 0};
 
 const OpDesc *get_op_desc(TokenType t) {
   if ((unsigned)t < (unsigned)(sizeof(op_table) / sizeof(op_table[0]))) {
@@ -7,8 +7,14 @@
 typedef struct {
   UnaryFunc unary;
   BinaryFunc binary;
+  bool impure;    // results differ between calls, so never folded
+  uint8_t atomic; // ATOMIC_* forms that apply item by item to lists
 } OpDesc;
 
+#define ATOMIC_UNARY 1
+#define ATOMIC_BINARY 2
+#define ATOMIC_BOTH (ATOMIC_UNARY | ATOMIC_BINARY)
+
 typedef enum { ASSOC_LEFT, ASSOC_RIGHT, ASSOC_NONE } Assoc;
 
 typedef struct {
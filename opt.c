@@ -0,0 +1,231 @@
+#include "opt.h"
+#include "ast.h"
+#include "builtins.h"
+#include "def.h"
+#include "ops.h"
+#include <stdbool.h>
+
+// Larger results stay computed at run time rather than pinned in the tree.
+#define FOLD_MAX 1024
+
+static bool is_literal(ASTNode *n) {
+  return n && n->type == AST_LITERAL && n->as.literal.value;
+}
+
+// Only ints and floats, alone or in flat vectors, are folded: on those the
+// verbs below cannot fail, so folding never prints an error early or for a
+// branch that is not taken.
+static bool numeric(ASTNode *n) {
+  if (!is_literal(n))
+    return false;
+  KObj *v = n->as.literal.value;
+  if (v->type == INT || v->type == FLOAT)
+    return true;
+  return v->type == VECTOR &&
+         (v->as.vector->elem == INT || v->as.vector->elem == FLOAT);
+}
+
+static size_t length(KObj *v) {
+  if (v->type == VECTOR)
+    return v->as.vector->length;
+  if (v->type == DICT)
+    return v->as.dict->keys->as.vector->length;
+  return 1;
+}
+
+// |v| as a count, or FOLD_MAX + 1 when it is larger.
+static size_t magnitude(KObj *v) {
+  double d = v->type == INT ? (double)v->as.int_value : v->as.float_value;
+  d = d < 0 ? -d : d;
+  return d > FOLD_MAX ? FOLD_MAX + 1 : (size_t)d;
+}
+
+// The items op on x builds, worked out before running it so that a huge
+// result is never allocated; anything over FOLD_MAX is FOLD_MAX + 1.
+static size_t unary_size(TokenType op, KObj *x) {
+  if (op != BANG && op != AMP)
+    return length(x);
+  if (x->type != VECTOR)
+    return magnitude(x);
+  // the odometer has a row of the product per item; where sums the counts
+  size_t n = x->as.vector->length, total = op == BANG ? 1 : 0;
+  for (size_t i = 0; i < n && total <= FOLD_MAX; i++) {
+    KObj *item = vector_get(x, i);
+    size_t m = magnitude(item);
+    release_object(item);
+    total = op == BANG ? total * m : total + m;
+  }
+  if (op == BANG && total <= FOLD_MAX)
+    total *= n;
+  return total > FOLD_MAX ? FOLD_MAX + 1 : total;
+}
+
+static size_t binary_size(TokenType op, KObj *x, KObj *y) {
+  if (op == HASH)
+    return magnitude(x);
+  if (op == COMMA)
+    return length(x) + length(y);
+  return length(x) > length(y) ? length(x) : length(y);
+}
+
+static bool can_fold_unary(TokenType op, KObj *x) {
+  if (unary_size(op, x) > FOLD_MAX)
+    return false;
+  if (op == PLUS) // flip
+    return false;
+  if (op == STAR) // first
+    return x->type != VECTOR || x->as.vector->length > 0;
+  return true;
+}
+
+static bool can_fold_binary(TokenType op, KObj *x, KObj *y) {
+  if (binary_size(op, x, y) > FOLD_MAX)
+    return false;
+  if (op == HASH || op == UNDERSCORE) // take, drop
+    return x->type == INT;
+  if (op == COMMA || op == TILDE)
+    return true;
+  return x->type != VECTOR || y->type != VECTOR ||
+         x->as.vector->length == y->as.vector->length;
+}
+
+// Turns n into a literal holding value, dropping what it was built from.
+static void make_literal(ASTNode *n, KObj *value) {
+  ASTNode old = *n;
+  n->type = AST_LITERAL;
+  n->as.literal.value = value;
+  switch (old.type) {
+  case AST_UNARY:
+    free_ast(old.as.unary.child);
+    break;
+  case AST_BINARY:
+    free_ast(old.as.binary.left);
+    free_ast(old.as.binary.right);
+    break;
+  case AST_LIST:
+    for (size_t i = 0; i < old.as.seq.count; i++)
+      free_ast(old.as.seq.items[i]);
+    break;
+  default:
+    break;
+  }
+}
+
+static void fold(ASTNode *n, KObj *value) {
+  if (value->type == NIL || length(value) > FOLD_MAX) {
+    release_object(value);
+    return;
+  }
+  make_literal(n, value);
+}
+
+static void fold_unary(ASTNode *n) {
+  TokenType op = n->as.unary.op.type;
+  const OpDesc *d = get_op_desc(op);
+  ASTNode *child = n->as.unary.child;
+  if (op == BAR && child && child->type == AST_UNARY &&
+      child->as.unary.op.type == op) {
+    // reverse undoes itself
+    ASTNode *inner = child->as.unary.child;
+    if (inner) {
+      *n = *inner;
+      return;
+    }
+  }
+  if (!d->unary || d->impure || !numeric(child))
+    return;
+  KObj *x = child->as.literal.value;
+  if (can_fold_unary(op, x))
+    fold(n, k_unary_owned(d->unary, x));
+}
+
+static void fold_binary(ASTNode *n) {
+  TokenType op = n->as.binary.op.type;
+  const OpDesc *d = get_op_desc(op);
+  ASTNode *left = n->as.binary.left, *right = n->as.binary.right;
+  if (op == COLON || !d->binary || d->impure || !numeric(left) ||
+      !numeric(right))
+    return;
+  KObj *x = left->as.literal.value, *y = right->as.literal.value;
+  if (can_fold_binary(op, x, y))
+    fold(n, k_binary_owned(d->binary, x, y));
+}
+
+// (1;2.5;3) built once, like the vector literal 1 2.5 3 would be.
+static void fold_list(ASTNode *n) {
+  size_t count = n->as.seq.count;
+  if (count == 0 || count > FOLD_MAX)
+    return;
+  for (size_t i = 0; i < count; i++) {
+    ASTNode *item = n->as.seq.items[i];
+    if (!is_literal(item) || item->as.literal.value->type == VECTOR)
+      return;
+  }
+  KObj *vec = create_vec(count);
+  for (size_t i = 0; i < count; i++)
+    vector_append(vec, n->as.seq.items[i]->as.literal.value);
+  make_literal(n, vec);
+}
+
+// Keeps only the branch a literal condition takes; true when it did.
+static bool prune(ASTNode *n) {
+  ASTNode *cond = n->as.conditional.condition;
+  if (!is_literal(cond))
+    return false;
+  KObj *c = cond->as.literal.value;
+  bool taken = c->type == INT     ? c->as.int_value != 0
+               : c->type == FLOAT ? c->as.float_value != 0.0
+                                  : true;
+  ASTNode *keep = taken ? n->as.conditional.then_branch
+                        : n->as.conditional.else_branch;
+  free_ast(cond);
+  free_ast(taken ? n->as.conditional.else_branch
+                 : n->as.conditional.then_branch);
+  *n = *keep;
+  return true;
+}
+
+ASTNode *optimize(ASTNode *n) {
+  if (!n)
+    return n;
+  switch (n->type) {
+  case AST_LITERAL:
+  case AST_VAR:
+    break;
+  case AST_UNARY:
+    optimize(n->as.unary.child);
+    fold_unary(n);
+    break;
+  case AST_BINARY:
+    optimize(n->as.binary.left);
+    optimize(n->as.binary.right);
+    fold_binary(n);
+    break;
+  case AST_CALL:
+    optimize(n->as.call.callee);
+    for (size_t i = 0; i < n->as.call.arg_count; i++)
+      optimize(n->as.call.args[i]);
+    break;
+  case AST_SEQ:
+    for (size_t i = 0; i < n->as.seq.count; i++)
+      optimize(n->as.seq.items[i]);
+    break;
+  case AST_LIST:
+    for (size_t i = 0; i < n->as.seq.count; i++)
+      optimize(n->as.seq.items[i]);
+    fold_list(n);
+    break;
+  case AST_CONDITIONAL:
+    // the branch that is never taken is dropped before it is folded
+    optimize(n->as.conditional.condition);
+    if (prune(n))
+      return optimize(n);
+    optimize(n->as.conditional.then_branch);
+    optimize(n->as.conditional.else_branch);
+    break;
+  case AST_ADVERB:
+    optimize(n->as.adverb.child);
+    break;
+  }
+  return n;
+}
@@ -0,0 +1,11 @@
+#ifndef OPT_H_
+#define OPT_H_
+
+#include "ast.h"
+
+// Rewrites node in place before it is compiled: constant subexpressions
+// become literals, $[c;a;b] with a constant c becomes the branch taken, and
+// -(-x) and |(|x) become x. Returns node.
+ASTNode *optimize(ASTNode *node);
+
+#endif
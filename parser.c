@@ -3,6 +3,7 @@
 #include "def.h"
 #include "eval.h"
 #include "ops.h"
+#include "sym.h"
 #include <ctype.h>
 #include <limits.h>
 #include <stdbool.h>
@@ -23,7 +24,7 @@ static bool parse_args_until(Parser *parser, TokenType closing,
   size_t arg_capacity = 4;
   size_t arg_count = 0;
   args =
-      (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *) * arg_capacity);
+      (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * arg_capacity);
   if (parser->current.type != closing) {
     while (true) {
       ASTNode *arg = parse_expression(parser);
@@ -37,7 +38,7 @@ static bool parse_args_until(Parser *parser, TokenType closing,
       if (arg_count >= arg_capacity) {
         arg_capacity *= 2;
         ASTNode **new_args = (ASTNode **)arena_alloc(
-            &global_arena, sizeof(ASTNode *) * arg_capacity);
+            ast_arena, sizeof(ASTNode *) * arg_capacity);
         memcpy(new_args, args, arg_count * sizeof(ASTNode *));
         args = new_args;
       }
@@ -209,17 +210,15 @@ static KObj *token_to_number(Token token) {
 }
 
 static KObj *token_to_string(Token token) {
-  KObj *vec = create_vec(token.length);
-  for (int i = 0; i < token.length; i++) {
-    KObj *ch = create_char(token.start[i]);
-    vector_append(vec, ch);
-    release_object(ch);
-  }
+  KObj *vec = create_typed_vec(CHAR, (size_t)token.length);
+  if (token.length > 0)
+    memcpy(vec->as.vector->chars, token.start, (size_t)token.length);
+  vec->as.vector->length = (size_t)token.length;
   return vec;
 }
 
 static KObj *token_to_symbol(Token token) {
-  char *name = (char *)arena_alloc(&global_arena, token.length + 1);
+  char *name = (char *)arena_alloc(ast_arena, token.length + 1);
   memcpy(name, token.start, token.length);
   name[token.length] = '\0';
   KObj *sym = create_symbol(name);
@@ -385,7 +384,7 @@ static ASTNode *parse_list(Parser *parser) {
   advance(parser); // (
   ASTNode **items = NULL;
   size_t count = 0, capacity = 4;
-  items = (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *) * capacity);
+  items = (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * capacity);
   while (parser->current.type != RPAREN && parser->current.type != KEOF) {
     ASTNode *elem = parse_expression(parser);
     if (!elem) {
@@ -398,7 +397,7 @@ static ASTNode *parse_list(Parser *parser) {
     if (count >= capacity) {
       capacity *= 2;
       ASTNode **new_items =
-          (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *) * capacity);
+          (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * capacity);
       memcpy(new_items, items, count * sizeof(ASTNode *));
       items = new_items;
     }
@@ -421,6 +420,11 @@ static ASTNode *parse_list(Parser *parser) {
 
 static ASTNode *parse_lambda(Parser *parser) {
   advance(parser); // {
+  // The body outlives the statement, so it gets an arena of its own.
+  Arena *outer_arena = ast_arena;
+  Arena lambda_arena;
+  arena_init(&lambda_arena);
+  ast_arena = &lambda_arena;
   char **params = NULL;
   int param_capacity = 4;
   int param_count = 0;
@@ -431,20 +435,18 @@ static ASTNode *parse_lambda(Parser *parser) {
   if (parser->current.type == LBRACKET) {
     advance(parser); // [
     params =
-        (char **)arena_alloc(&global_arena, sizeof(char *) * param_capacity);
+        (char **)arena_alloc(ast_arena, sizeof(char *) * param_capacity);
     while (parser->current.type != RBRACKET && parser->current.type != KEOF) {
       if (parser->current.type != IDENT) {
         printf("^param\n");
         goto error;
       }
       Token t = parser->current;
-      char *name = (char *)arena_alloc(&global_arena, t.length + 1);
-      memcpy(name, t.start, t.length);
-      name[t.length] = '\0';
+      char *name = (char *)sym_intern(t.start, t.length);
       if (param_count >= param_capacity) {
         param_capacity *= 2;
         char **new_params = (char **)arena_alloc(
-            &global_arena, sizeof(char *) * param_capacity);
+            ast_arena, sizeof(char *) * param_capacity);
         memcpy(new_params, params, param_count * sizeof(char *));
         params = new_params;
       }
@@ -466,7 +468,7 @@ static ASTNode *parse_lambda(Parser *parser) {
   }
 
   body =
-      (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *) * body_capacity);
+      (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * body_capacity);
   while (parser->current.type != RBRACE && parser->current.type != KEOF) {
     ASTNode *expr = parse_expression(parser);
     if (!expr)
@@ -474,7 +476,7 @@ static ASTNode *parse_lambda(Parser *parser) {
     if (body_count >= body_capacity) {
       body_capacity *= 2;
       ASTNode **new_body = (ASTNode **)arena_alloc(
-          &global_arena, sizeof(ASTNode *) * body_capacity);
+          ast_arena, sizeof(ASTNode *) * body_capacity);
       memcpy(new_body, body, body_count * sizeof(ASTNode *));
       body = new_body;
     }
@@ -490,15 +492,20 @@ static ASTNode *parse_lambda(Parser *parser) {
     goto error;
   }
   advance(parser); // }
-  KObj *lambda_obj =
-      create_lambda(param_count, params, body, body_count, !last_semicolon);
-  return create_literal_node(lambda_obj);
+  ast_arena = outer_arena;
+  KObj *lambda_obj = create_lambda(param_count, params, body, body_count,
+                                   !last_semicolon, &lambda_arena);
+  ASTNode *node = create_literal_node(lambda_obj);
+  release_object(lambda_obj);
+  return node;
 
 error:
   if (body) {
     for (size_t i = 0; i < body_count; i++)
       free_ast(body[i]);
   }
+  ast_arena = outer_arena;
+  arena_reset(&lambda_arena);
   return NULL;
 }
 
@@ -506,10 +513,7 @@ static ASTNode *parse_primary(Parser *parser) {
   Token tok;
   if (read_atom(parser, &tok)) {
     if (tok.type == IDENT) {
-      char *name = (char *)arena_alloc(&global_arena, tok.length + 1);
-      memcpy(name, tok.start, tok.length);
-      name[tok.length] = '\0';
-      return create_var_node(name);
+      return create_var_node(sym_intern(tok.start, tok.length));
     }
     KObj *first_val = token_to_atom(tok);
     if (tok.type != IDENT) {
@@ -525,15 +529,19 @@ static ASTNode *parse_primary(Parser *parser) {
           (void)read_atom(parser, &next_tok);
           KObj *val = token_to_atom(next_tok);
           if (!val) {
-            return create_literal_node(vec);
+            break;
           }
           vector_append(vec, val);
           release_object(val);
         }
-        return create_literal_node(vec);
+        ASTNode *node = create_literal_node(vec);
+        release_object(vec);
+        return node;
       }
     }
-    return create_literal_node(first_val);
+    ASTNode *node = create_literal_node(first_val);
+    release_object(first_val);
+    return node;
   }
   if (parser->current.type == SIN || parser->current.type == COS ||
       parser->current.type == ABS || parser->current.type == EXP ||
@@ -698,7 +706,7 @@ static ASTNode *parse_postfix(Parser *parser) {
           if (more_n > 0) {
             size_t new_n = arg_count + more_n;
             ASTNode **combined = (ASTNode **)arena_alloc(
-                &global_arena, sizeof(ASTNode *) * new_n);
+                ast_arena, sizeof(ASTNode *) * new_n);
             if (arg_count > 0 && args)
               memcpy(combined, args, arg_count * sizeof(ASTNode *));
             memcpy(combined + arg_count, more, more_n * sizeof(ASTNode *));
@@ -718,7 +726,7 @@ static ASTNode *parse_postfix(Parser *parser) {
         ASTNode *lit = create_literal_node(vec);
         release_object(vec);
         ASTNode **new_args =
-            (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *));
+            (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *));
         new_args[0] = lit;
         node = create_call_node(node, new_args, 1);
       } else {
@@ -741,7 +749,7 @@ static ASTNode *parse_postfix(Parser *parser) {
         return NULL;
       }
       ASTNode **args =
-          (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *));
+          (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *));
       args[0] = arg;
       node = create_call_node(node, args, 1);
       continue;
@@ -765,14 +773,14 @@ static ASTNode *parse_postfix(Parser *parser) {
         ASTNode *adverb = arg->as.call.callee;
         ASTNode *right = arg->as.call.args[0];
         ASTNode **call_args =
-            (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *) * 2);
+            (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * 2);
         call_args[0] = node;
         call_args[1] = right;
         node = create_call_node(adverb, call_args, 2);
         continue;
       }
       ASTNode **args =
-          (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *));
+          (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *));
       args[0] = arg;
       node = create_call_node(node, args, 1);
       continue;
@@ -905,14 +913,19 @@ static ASTNode *parse_unary(Parser *parser) {
           return node;
         }
       }
-      ASTNode *body = create_var_node("x");
+      Arena *outer_arena = ast_arena;
+      Arena lambda_arena;
+      arena_init(&lambda_arena);
+      ast_arena = &lambda_arena;
+      ASTNode *body = create_var_node(sym_intern("x", 1));
       for (int i = count - 1; i >= 0; i--) {
         body = create_unary_node(ops[i], body);
       }
       ASTNode **body_arr =
-          (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *));
+          (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *));
       body_arr[0] = body;
-      KObj *lam = create_lambda(0, NULL, body_arr, 1, true);
+      ast_arena = outer_arena;
+      KObj *lam = create_lambda(0, NULL, body_arr, 1, true, &lambda_arena);
       ASTNode *lam_node = create_literal_node(lam);
       release_object(lam);
       free(ops);
@@ -971,7 +984,7 @@ static ASTNode *parse_expression(Parser *parser) {
       release_object(verb);
       ASTNode *adverb = create_adverb_node(adv, verb_node);
       ASTNode **args =
-          (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *) * 2);
+          (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * 2);
       args[0] = left_node;
       args[1] = right_node;
       return create_call_node(adverb, args, 2);
@@ -993,11 +1006,14 @@ void init_parser(Parser *parser, Lexer *lexer) {
 
 ASTNode *parse(Parser *parser) {
   if (parser->current.type == KEOF) {
-    return create_literal_node(create_nil());
+    KObj *nil = create_nil();
+    ASTNode *node = create_literal_node(nil);
+    release_object(nil);
+    return node;
   }
   ASTNode **items = NULL;
   size_t count = 0, cap = 4;
-  items = (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *) * cap);
+  items = (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * cap);
   while (true) {
     ASTNode *expr = parse_expression(parser);
     if (!expr) {
@@ -1010,7 +1026,7 @@ ASTNode *parse(Parser *parser) {
     if (count >= cap) {
       cap *= 2;
       ASTNode **new_items =
-          (ASTNode **)arena_alloc(&global_arena, sizeof(ASTNode *) * cap);
+          (ASTNode **)arena_alloc(ast_arena, sizeof(ASTNode *) * cap);
       memcpy(new_items, items, count * sizeof(ASTNode *));
       items = new_items;
     }
@@ -1,9 +1,12 @@
+#include "arena.h"
 #include "ast.h"
 #include "def.h"
 #include "eval.h"
+#include "jit.h"
 #include "lex.h"
 #include "ops.h"
 #include "parser.h"
+#include "slab.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,13 +24,22 @@ static char *k_strdup(const char *s) {
 static int is_char_vector(KObj *obj) {
   if (!obj || obj->type != VECTOR)
     return 0;
-  for (size_t i = 0; i < obj->as.vector->length; i++) {
-    if (obj->as.vector->items[i].type != CHAR)
+  KVec *v = obj->as.vector;
+  if (v->elem != NIL)
+    return v->elem == CHAR || v->length == 0;
+  for (size_t i = 0; i < v->length; i++) {
+    if (v->items[i]->type != CHAR)
       return 0;
   }
   return 1;
 }
 
+// Character i of a vector already known to be a char vector.
+static char char_at(KObj *obj, size_t i) {
+  KVec *v = obj->as.vector;
+  return v->elem == CHAR ? v->chars[i] : v->items[i]->as.char_value;
+}
+
 static char *kobj_to_string(KObj *obj);
 static void print_inline(KObj *obj);
 
@@ -74,19 +86,12 @@ static char *ast_to_string(ASTNode *node) {
     }
     if (v->type == VECTOR) {
       // string literal
-      int is_str = 1;
-      for (size_t i = 0; i < v->as.vector->length; i++) {
-        if (v->as.vector->items[i].type != CHAR) {
-          is_str = 0;
-          break;
-        }
-      }
-      if (is_str) {
+      if (is_char_vector(v)) {
         size_t n = v->as.vector->length;
         char *s = (char *)malloc(n + 3);
         s[0] = '"';
         for (size_t i = 0; i < n; i++)
-          s[1 + i] = v->as.vector->items[i].as.char_value;
+          s[1 + i] = char_at(v, i);
         s[1 + n] = '"';
         s[2 + n] = '\0';
         return s;
@@ -143,8 +148,11 @@ static char *vector_to_string(KObj *vec) {
     size_t len = vec->as.vector->length;
     char *res = (char *)malloc(len + 3);
     res[0] = '"';
-    for (size_t i = 0; i < len; i++) {
-      res[i + 1] = vec->as.vector->items[i].as.char_value;
+    if (vec->as.vector->elem == CHAR && len > 0) {
+      memcpy(res + 1, vec->as.vector->chars, len);
+    } else {
+      for (size_t i = 0; i < len; i++)
+        res[i + 1] = char_at(vec, i);
     }
     res[len + 1] = '"';
     res[len + 2] = '\0';
@@ -154,7 +162,9 @@ static char *vector_to_string(KObj *vec) {
   char **parts = (char **)malloc(n * sizeof(char *));
   size_t total = 2;
   for (size_t i = 0; i < n; i++) {
-    parts[i] = kobj_to_string(&vec->as.vector->items[i]);
+    KObj *item = vector_get(vec, i);
+    parts[i] = kobj_to_string(item);
+    release_object(item);
     total += strlen(parts[i]);
     if (i + 1 < n)
       total++;
@@ -305,8 +315,12 @@ static char *kobj_to_string(KObj *obj) {
     char **parts = (char **)malloc(n * sizeof(char *));
     size_t total = 2; // for parentheses
     for (size_t i = 0; i < n; i++) {
-      char *k = kobj_to_string(&keys->as.vector->items[i]);
-      char *v = kobj_to_string(&vals->as.vector->items[i]);
+      KObj *ko = vector_get(keys, i);
+      KObj *vo = vector_get(vals, i);
+      char *k = kobj_to_string(ko);
+      char *v = kobj_to_string(vo);
+      release_object(ko);
+      release_object(vo);
       size_t pair_len = strlen(k) + 1 + strlen(v); // k|v
       parts[i] = (char *)malloc(pair_len + 1);
       snprintf(parts[i], pair_len + 1, "%s|%s", k, v);
@@ -350,7 +364,7 @@ static void print_inline(KObj *obj) {
     int uniform = 1;
     int first_type = -1;
     for (size_t i = 0; i < n; i++) {
-      KObj *item = &obj->as.vector->items[i];
+      KObj *item = vector_get(obj, i);
       if (item->type == VECTOR && !is_char_vector(item)) {
         need_paren = 1;
       }
@@ -359,13 +373,16 @@ static void print_inline(KObj *obj) {
       } else if (item->type != first_type) {
         uniform = 0;
       }
+      release_object(item);
     }
     if (!uniform)
       need_paren = 1;
     if (need_paren)
       putchar('(');
     for (size_t i = 0; i < n; i++) {
-      print_inline(&obj->as.vector->items[i]);
+      KObj *item = vector_get(obj, i);
+      print_inline(item);
+      release_object(item);
       if (i + 1 < n) {
         if (need_paren)
           putchar(';');
@@ -388,12 +405,13 @@ void print(KObj *obj) {
   if (!obj || obj->type == NIL) {
     return;
   }
+  vector_force(obj);
   if (obj->type == DICT) {
     KObj *keys = obj->as.dict->keys;
     KObj *vals = obj->as.dict->values;
     size_t len = keys->as.vector->length;
     for (size_t i = 0; i < len; i++) {
-      KObj *key_obj = &keys->as.vector->items[i];
+      KObj *key_obj = vector_get(keys, i);
       if (key_obj->type == SYM) {
         printf("%s|", key_obj->as.symbol_value);
       } else {
@@ -401,13 +419,16 @@ void print(KObj *obj) {
         printf("%s|", k);
         free(k);
       }
-      KObj *v = &vals->as.vector->items[i];
+      release_object(key_obj);
+      KObj *v = vector_get(vals, i);
       if (v->type == VECTOR && !is_char_vector(v)) {
         size_t l = v->as.vector->length;
         if (l == 1)
           putchar(',');
         for (size_t j = 0; j < l; j++) {
-          char *s = kobj_to_string(&v->as.vector->items[j]);
+          KObj *item = vector_get(v, j);
+          char *s = kobj_to_string(item);
+          release_object(item);
           printf("%s", s);
           free(s);
           if (j + 1 < l)
@@ -418,6 +439,7 @@ void print(KObj *obj) {
         printf("%s", s);
         free(s);
       }
+      release_object(v);
       putchar('\n');
     }
     return;
@@ -425,7 +447,9 @@ void print(KObj *obj) {
   if (obj->type == VECTOR && obj->as.vector->length == 1 &&
       !is_char_vector(obj)) {
     putchar(',');
-    print_inline(&obj->as.vector->items[0]);
+    KObj *item = vector_get(obj, 0);
+    print_inline(item);
+    release_object(item);
     putchar('\n');
     return;
   }
@@ -438,8 +462,13 @@ void print(KObj *obj) {
   int simple = 1;
   int all_strings = 1;
   int all_syms = 1;
-  for (size_t i = 0; i < obj->as.vector->length; i++) {
-    KObj *item = &obj->as.vector->items[i];
+  if (obj->as.vector->elem != NIL) {
+    all_strings = 0;
+    all_syms = obj->as.vector->elem == SYM;
+  }
+  for (size_t i = 0; i < obj->as.vector->length && obj->as.vector->elem == NIL;
+       i++) {
+    KObj *item = obj->as.vector->items[i];
     if (item->type == VECTOR && !is_char_vector(item)) {
       simple = 0;
     }
@@ -456,7 +485,7 @@ void print(KObj *obj) {
     if (all_strings) {
       int all_single_chars = 1;
       for (size_t i = 0; i < obj->as.vector->length; i++) {
-        KObj *item = &obj->as.vector->items[i];
+        KObj *item = obj->as.vector->items[i];
         if (item->as.vector->length != 1) {
           all_single_chars = 0;
           break;
@@ -465,20 +494,22 @@ void print(KObj *obj) {
       if (all_single_chars) {
         putchar('"');
         for (size_t i = 0; i < obj->as.vector->length; i++) {
-          KObj *item = &obj->as.vector->items[i];
-          putchar(item->as.vector->items[0].as.char_value);
+          KObj *item = obj->as.vector->items[i];
+          putchar(char_at(item, 0));
         }
         puts("\"");
       } else {
         for (size_t i = 0; i < obj->as.vector->length; i++) {
-          char *s = kobj_to_string(&obj->as.vector->items[i]);
+          char *s = kobj_to_string(obj->as.vector->items[i]);
           printf("%s\n", s);
           free(s);
         }
       }
     } else {
       for (size_t i = 0; i < obj->as.vector->length; i++) {
-        char *s = kobj_to_string(&obj->as.vector->items[i]);
+        KObj *item = vector_get(obj, i);
+        char *s = kobj_to_string(item);
+        release_object(item);
         printf("%s", s);
         if (!all_syms && i + 1 < obj->as.vector->length)
           putchar(' ');
@@ -493,7 +524,7 @@ void print(KObj *obj) {
   char ***cells = (char ***)malloc(rows * sizeof(char **));
   size_t max_cols = 0;
   for (size_t r = 0; r < rows; r++) {
-    KObj *row_obj = &obj->as.vector->items[r];
+    KObj *row_obj = obj->as.vector->items[r];
     if (row_obj->type == VECTOR && !is_char_vector(row_obj)) {
       size_t cols = row_obj->as.vector->length;
       row_len[r] = cols;
@@ -501,7 +532,9 @@ void print(KObj *obj) {
         max_cols = cols;
       cells[r] = (char **)malloc(cols * sizeof(char *));
       for (size_t c = 0; c < cols; c++) {
-        cells[r][c] = kobj_to_string(&row_obj->as.vector->items[c]);
+        KObj *item = vector_get(row_obj, c);
+        cells[r][c] = kobj_to_string(item);
+        release_object(item);
       }
     } else {
       row_len[r] = 1;
@@ -551,6 +584,12 @@ static char *trim_line(char *line) {
 }
 
 static void execute(const char *p, int print_result) {
+  // global_arena is this statement's scratch region: it holds the parse
+  // tree and the evaluator's short-lived buffers (argument arrays and the
+  // like, each bracketed by its own mark). Values never live there, so
+  // nothing has to be copied out before the release below; lambdas keep
+  // their bodies in arenas of their own.
+  ArenaMark mark = arena_mark(&global_arena);
   Lexer lexer;
   init_lexer(&lexer, p);
   Parser parser;
@@ -582,6 +621,7 @@ static void execute(const char *p, int print_result) {
   } else {
     printf("^parse\n");
   }
+  arena_release(&global_arena, mark);
 }
 
 static long long monotonic_ns(void) {
@@ -639,6 +679,23 @@ static void parse_timing_args(char *q, long *runs_out, char **expr_out) {
   *expr_out = expr;
 }
 
+// \w: object heap totals in bytes, parse arenas, live heap objects by
+// type, then the footprint of each global.
+static void workspace_dump(void) {
+  static const char *type_names[] = {
+      "nil",    "char", "int",  "float",  "pinf",   "ninf", "sym",
+      "vector", "dict", "verb", "adverb", "lambda", "proj"};
+  printf("live: %zu\n", slab_stats.live);
+  printf("total: %zu\n", slab_stats.total);
+  printf("peak: %zu\n", slab_stats.peak);
+  printf("arena: %zu\n", arena_bytes);
+  for (size_t t = 0; t <= PROJ; t++) {
+    if (live_objects[t])
+      printf("%s: %zu\n", type_names[t], live_objects[t]);
+  }
+  env_footprint();
+}
+
 static int process_line(char *p, int interactive) {
   if (*p == '\0') {
     if (interactive)
@@ -671,6 +728,21 @@ static int process_line(char *p, int interactive) {
       printf("  ");
     return 1;
   }
+  if (strcmp(p, "\\w") == 0) {
+    workspace_dump();
+    if (interactive)
+      printf("  ");
+    return 1;
+  }
+  if (strcmp(p, "\\jit") == 0) {
+    // toggles the JIT and reports how far it got
+    jit_enabled = !jit_enabled;
+    printf("jit %s: %zu compiled, %zu rejected\n", jit_enabled ? "on" : "off",
+           jit_compiled, jit_rejected);
+    if (interactive)
+      printf("  ");
+    return 1;
+  }
   if (strncmp(p, "\\t", 2) == 0) {
     char *q = p + 2;
     long runs = 1;
@@ -0,0 +1,41 @@
+#include "slab.h"
+
+#define SLAB_PAGE (64 * 1024)
+
+typedef struct SlabPage {
+  struct SlabPage *next;
+  _Alignas(max_align_t) unsigned char data[];
+} SlabPage;
+
+SlabBlock *slab_free_lists[SLAB_CLASSES];
+SlabStats slab_stats;
+
+static SlabPage *pages;
+
+// Carve a fresh page into blocks of class cls, keep all but one on the
+// free list and return that one.
+void *slab_refill(size_t cls) {
+  size_t block_size = (cls + 1) * SLAB_GRAIN;
+  size_t count = SLAB_PAGE / block_size;
+  SlabPage *page = (SlabPage *)malloc(sizeof(SlabPage) + count * block_size);
+  if (!page)
+    return NULL;
+  page->next = pages;
+  pages = page;
+  for (size_t i = count - 1; i > 0; i--) {
+    SlabBlock *block = (SlabBlock *)(page->data + i * block_size);
+    block->next = slab_free_lists[cls];
+    slab_free_lists[cls] = block;
+  }
+  return page->data;
+}
+
+void slab_dispose(void) {
+  while (pages) {
+    SlabPage *next = pages->next;
+    free(pages);
+    pages = next;
+  }
+  for (size_t i = 0; i < SLAB_CLASSES; i++)
+    slab_free_lists[i] = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+
+// Size-class allocator for object headers and small buffers. Requests up
+// to SLAB_MAX bytes are rounded up to a multiple of SLAB_GRAIN and served
+// from per-class free lists threaded through the free blocks themselves;
+// anything larger goes to malloc. Callers pass the size back on free.
+
+#define SLAB_GRAIN 16
+#define SLAB_CLASSES 16
+#define SLAB_MAX (SLAB_GRAIN * SLAB_CLASSES)
+
+typedef struct SlabBlock {
+  struct SlabBlock *next;
+} SlabBlock;
+
+// Bytes currently handed out, handed out since start, and the high-water
+// mark of live, for the \w command.
+typedef struct SlabStats {
+  size_t live;
+  size_t total;
+  size_t peak;
+} SlabStats;
+
+extern SlabBlock *slab_free_lists[SLAB_CLASSES];
+extern SlabStats slab_stats;
+
+void *slab_refill(size_t cls);
+void slab_dispose(void);
+
+static inline size_t slab_class(size_t size) {
+  return size ? (size - 1) / SLAB_GRAIN : 0;
+}
+
+// Inline so that fixed sizes such as sizeof(KObj) fold to a single list
+// pop on the hot path.
+static inline void *slab_alloc(size_t size) {
+  slab_stats.live += size;
+  slab_stats.total += size;
+  if (slab_stats.live > slab_stats.peak)
+    slab_stats.peak = slab_stats.live;
+  if (size > SLAB_MAX)
+    return malloc(size);
+  size_t cls = slab_class(size);
+  SlabBlock *block = slab_free_lists[cls];
+  if (!block)
+    return slab_refill(cls);
+  slab_free_lists[cls] = block->next;
+  return block;
+}
+
+static inline void slab_free(void *p, size_t size) {
+  if (!p)
+    return;
+  slab_stats.live -= size;
+  if (size > SLAB_MAX) {
+    free(p);
+    return;
+  }
+  size_t cls = slab_class(size);
+  SlabBlock *block = (SlabBlock *)p;
+  block->next = slab_free_lists[cls];
+  slab_free_lists[cls] = block;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include "sym.h"
+#include "arena.h"
+#include "def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static Arena sym_arena;
+static KSymbol **symbols; // by id
+static uint32_t count;
+static uint32_t capacity;
+static uint32_t *slots; // open addressing, id + 1, 0 when empty
+static size_t slot_count;
+
+static uint64_t hash_bytes(const char *s, size_t length) {
+  uint64_t h = 1469598103934665603ULL;
+  for (size_t i = 0; i < length; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void rehash(size_t new_count) {
+  uint32_t *new_slots = (uint32_t *)calloc(new_count, sizeof(uint32_t));
+  if (!new_slots)
+    oom();
+  for (uint32_t id = 0; id < count; id++) {
+    size_t p = (size_t)symbols[id]->hash & (new_count - 1);
+    while (new_slots[p])
+      p = (p + 1) & (new_count - 1);
+    new_slots[p] = id + 1;
+  }
+  free(slots);
+  slots = new_slots;
+  slot_count = new_count;
+}
+
+const char *sym_intern(const char *name, size_t length) {
+  uint64_t h = hash_bytes(name, length);
+  if (slot_count) {
+    size_t p = (size_t)h & (slot_count - 1);
+    for (; slots[p]; p = (p + 1) & (slot_count - 1)) {
+      KSymbol *s = symbols[slots[p] - 1];
+      if (s->hash == h && s->length == length &&
+          memcmp(s->name, name, length) == 0)
+        return s->name;
+    }
+  }
+  if (2 * (size_t)(count + 1) > slot_count)
+    rehash(slot_count ? slot_count * 2 : 64);
+  if (count == capacity) {
+    capacity = capacity ? capacity * 2 : 64;
+    symbols = (KSymbol **)realloc(symbols, capacity * sizeof(KSymbol *));
+    if (!symbols)
+      oom();
+  }
+  if (!sym_arena.next_size)
+    arena_init(&sym_arena);
+  KSymbol *s = (KSymbol *)arena_alloc(&sym_arena, sizeof(KSymbol) + length + 1);
+  if (!s)
+    oom();
+  s->hash = h;
+  s->id = count;
+  s->length = (uint32_t)length;
+  memcpy(s->name, name, length);
+  s->name[length] = '\0';
+  symbols[count++] = s;
+  size_t p = (size_t)h & (slot_count - 1);
+  while (slots[p])
+    p = (p + 1) & (slot_count - 1);
+  slots[p] = s->id + 1;
+  return s->name;
+}
+
+const char *sym_name(uint32_t id) { return symbols[id]->name; }
+
+// Lexicographic order, with the common equal case settled by pointer.
+int sym_cmp(const char *a, const char *b) {
+  if (a == b)
+    return 0;
+  int c = strcmp(a, b);
+  return c < 0 ? -1 : (c > 0);
+}
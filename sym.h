@@ -0,0 +1,32 @@
+#ifndef SYM_H_
+#define SYM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every distinct symbol name is stored once, for the life of the process.
+// Interned names compare by pointer, and their hash and small integer id
+// are kept just in front of the characters.
+
+typedef struct {
+  uint64_t hash;
+  uint32_t id;
+  uint32_t length;
+  char name[];
+} KSymbol;
+
+const char *sym_intern(const char *name, size_t length);
+const char *sym_name(uint32_t id);
+int sym_cmp(const char *a, const char *b);
+
+static inline const KSymbol *sym_entry(const char *sym) {
+  return (const KSymbol *)(sym - offsetof(KSymbol, name));
+}
+
+static inline uint32_t sym_id(const char *sym) { return sym_entry(sym)->id; }
+
+static inline uint64_t sym_hash(const char *sym) {
+  return sym_entry(sym)->hash;
+}
+
+#endif